@@ -3,11 +3,26 @@ HEADERS += \
     $$PWD/qtssh/sshtunnelout.h \
     $$PWD/qtssh/sshtunnelin.h \
     $$PWD/qtssh/sshprocess.h \
+    $$PWD/qtssh/sshcommand.h \
+    $$PWD/qtssh/sshshell.h \
+    $$PWD/qtssh/sshbatch.h \
+    $$PWD/qtssh/sshfleet.h \
     $$PWD/qtssh/sshchannel.h \
     $$PWD/qtssh/sshclient.h \
     $$PWD/qtssh/sshtunneloutsrv.h \
+    $$PWD/qtssh/sshsockssrv.h \
+    $$PWD/qtssh/sshlocalsocketsrv.h \
     $$PWD/qtssh/sshscpsend.h \
+    $$PWD/qtssh/sshscpget.h \
     $$PWD/qtssh/sshsftp.h \
+    $$PWD/qtssh/sshsftpfollow.h \
+    $$PWD/qtssh/sshremotewatcher.h \
+    $$PWD/qtssh/sshmirror.h \
+    $$PWD/qtssh/sshchunkqueue.h \
+    $$PWD/qtssh/sshbuffer.h \
+    $$PWD/qtssh/sshutils.h \
+    $$PWD/qtssh/sshcompressedtransfer.h \
+    $$PWD/qtssh/sshtartransfer.h \
     $$PWD/qtssh/sshworker.h \
     $$PWD/qtssh/sshinterface.h \
     $$PWD/qtssh/sshfsinterface.h \
@@ -18,13 +33,29 @@ SOURCES += \
     $$PWD/qtssh/sshtunnelout.cpp \
     $$PWD/qtssh/sshtunnelin.cpp \
     $$PWD/qtssh/sshprocess.cpp \
+    $$PWD/qtssh/sshcommand.cpp \
+    $$PWD/qtssh/sshshell.cpp \
+    $$PWD/qtssh/sshbatch.cpp \
+    $$PWD/qtssh/sshfleet.cpp \
     $$PWD/qtssh/sshchannel.cpp \
     $$PWD/qtssh/sshclient.cpp \
     $$PWD/qtssh/sshtunneloutsrv.cpp \
+    $$PWD/qtssh/sshsockssrv.cpp \
+    $$PWD/qtssh/sshlocalsocketsrv.cpp \
     $$PWD/qtssh/sshscpsend.cpp \
+    $$PWD/qtssh/sshscpget.cpp \
     $$PWD/qtssh/sshsftp.cpp \
+    $$PWD/qtssh/sshsftpfollow.cpp \
+    $$PWD/qtssh/sshremotewatcher.cpp \
+    $$PWD/qtssh/sshmirror.cpp \
+    $$PWD/qtssh/sshchunkqueue.cpp \
+    $$PWD/qtssh/sshbuffer.cpp \
+    $$PWD/qtssh/sshutils.cpp \
+    $$PWD/qtssh/sshcompressedtransfer.cpp \
+    $$PWD/qtssh/sshtartransfer.cpp \
     $$PWD/qtssh/sshworker.cpp \
     $$PWD/qtssh/sshfilesystemmodel.cpp \
     $$PWD/qtssh/sshfilesystemnode.cpp
 
 INCLUDEPATH += $$PWD/qtssh
+LIBS += -lz
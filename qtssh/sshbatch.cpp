@@ -0,0 +1,178 @@
+#include "sshbatch.h"
+#include "sshclient.h"
+#include "sshprocess.h"
+#include "sshutils.h"
+#include <QEventLoop>
+#include <QTimer>
+#include <QDebug>
+
+SshBatch::SshBatch(SshClient *client, QStringList commands, Mode mode):
+    QObject(client),
+    _client(client),
+    _mode(mode),
+    _parser(new SshSentinelParser()),
+    _process(NULL),
+    _done(0),
+    _finished(false)
+{
+    foreach(QString command, commands)
+    {
+        Result result;
+        result.command  = command;
+        result.exitCode = -1;
+        result.executed = false;
+        _parser->expect(quint64(_results.size()));
+        _results << result;
+    }
+}
+
+SshBatch::~SshBatch()
+{
+    delete _process;
+    delete _parser;
+}
+
+QByteArray SshBatch::_script() const
+{
+    QByteArray script;
+    for(int i = 0; i < _results.size(); ++i)
+    {
+        /* Same frame as SshShell : a syntax error does not end the script */
+        script += _parser->frame(quint64(i), _results.at(i).command);
+        if(_mode == StopOnError)
+        {
+            script += "[ $__qtssh_rc -eq 0 ] || exit $__qtssh_rc\n";
+        }
+    }
+    script += "exit 0\n";
+    return script;
+}
+
+void SshBatch::start()
+{
+    if(_process || _finished) return;
+    if(_results.isEmpty())
+    {
+        _finished = true;
+        emit finished();
+        return;
+    }
+    _process = new SshProcess(_client);
+    QObject::connect(_process, &SshProcess::connected, this, &SshBatch::_started);
+    QObject::connect(_process, &SshProcess::readyReadStandardOutput, this, &SshBatch::_stdoutData);
+    QObject::connect(_process, &SshProcess::readyReadStandardError, this, &SshBatch::_stderrData);
+    QObject::connect(_process, &SshProcess::finished, this, &SshBatch::_processFinished);
+    QObject::connect(_process, &SshProcess::channelOpenFailed, this, &SshBatch::_processFinished);
+    /* The script comes on stdin : no limit on the number of commands */
+    _process->start("sh -s");
+}
+
+bool SshBatch::run()
+{
+    start();
+    waitForFinished();
+    return ok();
+}
+
+bool SshBatch::waitForFinished(int msecs)
+{
+    if(_finished) return true;
+
+    QEventLoop loop;
+    QTimer timer;
+    QObject::connect(this, &SshBatch::finished, &loop, &QEventLoop::quit);
+    QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+    if(msecs >= 0)
+    {
+        timer.setSingleShot(true);
+        timer.start(msecs);
+    }
+    loop.exec();
+    return _finished;
+}
+
+bool SshBatch::isFinished() const
+{
+    return _finished;
+}
+
+bool SshBatch::ok() const
+{
+    return _finished && failedIndex() < 0;
+}
+
+int SshBatch::failedIndex() const
+{
+    for(int i = 0; i < _results.size(); ++i)
+    {
+        if(!_results.at(i).executed || _results.at(i).exitCode != 0) return i;
+    }
+    return -1;
+}
+
+QList<SshBatch::Result> SshBatch::results() const
+{
+    return _results;
+}
+
+void SshBatch::_started()
+{
+#if defined(DEBUG_SSHCHANNEL)
+    qDebug() << "DEBUG : SshBatch : " << _results.size() << " command(s) sent";
+#endif
+    _process->write(_script());
+    _process->closeWriteChannel();
+}
+
+void SshBatch::_stdoutData()
+{
+    _parser->parseOutput(_process->readAllStandardOutput());
+    _complete();
+}
+
+void SshBatch::_stderrData()
+{
+    _parser->parseError(_process->readAllStandardError());
+    _complete();
+}
+
+void SshBatch::_complete()
+{
+    SshSentinelParser::Entry entry;
+    while(_parser->takeFinished(entry))
+    {
+        Result &result = _results[int(entry.id)];
+        result.output      = entry.output;
+        result.errorOutput = entry.errorOutput;
+        result.exitCode    = entry.exitCode;
+        result.executed    = true;
+        emit commandFinished(_done);
+        _done++;
+    }
+}
+
+void SshBatch::_processFinished()
+{
+    if(_finished) return;
+
+    _stdoutData();
+    _stderrData();
+    SshSentinelParser::Entry entry;
+    if(_parser->takeUnfinished(entry))
+    {
+        /* Output of the command that was running when the script ended */
+        Result &result = _results[int(entry.id)];
+        result.output      = entry.output;
+        result.errorOutput = entry.errorOutput;
+        result.exitCode    = entry.exitCode;
+        if(_mode == ContinueOnError || _done == 0 || _results.at(_done - 1).exitCode == 0)
+        {
+            qDebug() << "WARNING : SshBatch : script ended before " << result.command;
+        }
+    }
+    _parser->reset();
+    _process->deleteLater();
+    _process = NULL;
+    _finished = true;
+    emit finished();
+}
@@ -0,0 +1,77 @@
+#ifndef SSHBATCH_H
+#define SSHBATCH_H
+
+#include <QObject>
+#include <QList>
+#include <QStringList>
+#include <QByteArray>
+
+class SshClient;
+class SshProcess;
+class SshSentinelParser;
+
+/*
+ * Ordered list of commands run by a single remote shell on one exec
+ * channel. The generated script is fed on stdin : every command is
+ * followed by a sentinel on stdout (carrying its exit code) and on stderr,
+ * from which the output of each command is split back. Commands share the
+ * shell state, so they may depend on each other (cd, variables).
+ *
+ * In StopOnError mode the script exits on the first failing command, the
+ * following ones are reported as not executed.
+ */
+class SshBatch : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode {
+        StopOnError,
+        ContinueOnError
+    };
+
+    struct Result {
+        QString command;
+        QByteArray output;
+        QByteArray errorOutput;
+        int exitCode;
+        bool executed;
+    };
+
+private:
+    SshClient *_client;
+    Mode _mode;
+    SshSentinelParser *_parser;
+    SshProcess *_process;
+    QList<Result> _results;
+    int _done;
+    bool _finished;
+
+public:
+    SshBatch(SshClient *client, QStringList commands, Mode mode = StopOnError);
+    virtual ~SshBatch();
+
+    void start();
+    bool run();
+    bool waitForFinished(int msecs = -1);
+    bool isFinished() const;
+    bool ok() const;
+    int failedIndex() const;
+    QList<Result> results() const;
+
+signals:
+    void commandFinished(int index);
+    void finished();
+
+private slots:
+    void _started();
+    void _stdoutData();
+    void _stderrData();
+    void _processFinished();
+
+private:
+    QByteArray _script() const;
+    void _complete();
+};
+
+#endif // SSHBATCH_H
@@ -0,0 +1,195 @@
+#include "sshbuffer.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QScopedPointer>
+#include <QTextCodec>
+#include <QTextDecoder>
+#include <climits>
+#include <string.h>
+
+#define SSHBUFFER_BLOCK (64 * 1024)
+#define SSHBUFFER_POOL 64
+/* Smaller blocks are copied out : handing them over would pin 64 KB each */
+#define SSHBUFFER_ZEROCOPY (SSHBUFFER_BLOCK / 4)
+
+static QMutex blockPoolLock;
+static QList<QByteArray> blockPool;
+
+QByteArray SshBuffer::_allocBlock()
+{
+    QMutexLocker lock(&blockPoolLock);
+    if(!blockPool.isEmpty())
+    {
+        return blockPool.takeLast();
+    }
+    return QByteArray(SSHBUFFER_BLOCK, Qt::Uninitialized);
+}
+
+void SshBuffer::_recycleBlock(const QByteArray &block)
+{
+    /* Blocks still referenced by a consumer are left to it */
+    if(!block.isDetached() || block.size() != SSHBUFFER_BLOCK) return;
+    QMutexLocker lock(&blockPoolLock);
+    if(blockPool.size() < SSHBUFFER_POOL)
+    {
+        blockPool.append(block);
+    }
+}
+
+SshBuffer::SshBuffer():
+    _head(0),
+    _tail(0),
+    _size(0)
+{
+}
+
+SshBuffer::~SshBuffer()
+{
+    clear();
+}
+
+qint64 SshBuffer::size() const
+{
+    return _size;
+}
+
+bool SshBuffer::isEmpty() const
+{
+    return _size == 0;
+}
+
+int SshBuffer::_end() const
+{
+    /* End of the readable part of the first block */
+    return (_blocks.size() == 1)?(_tail):(_blocks.first().size());
+}
+
+char *SshBuffer::reserve(int &len)
+{
+    if(_blocks.isEmpty() || _tail == _blocks.last().size())
+    {
+        _blocks.append(_allocBlock());
+        _tail = 0;
+    }
+    len = _blocks.last().size() - _tail;
+    return _blocks.last().data() + _tail;
+}
+
+void SshBuffer::commit(int len)
+{
+    _tail += len;
+    _size += len;
+}
+
+qint64 SshBuffer::read(char *data, qint64 len)
+{
+    qint64 done = 0;
+
+    while(done < len && _size > 0)
+    {
+        int end = _end();
+        int count = int(qMin<qint64>(len - done, end - _head));
+        if(data) memcpy(data + done, _blocks.first().constData() + _head, size_t(count));
+        done  += count;
+        _head += count;
+        _size -= count;
+        if(_head == end)
+        {
+            _head = 0;
+            if(_blocks.size() == 1)
+            {
+                /* Keep the last block for the next reads */
+                _tail = 0;
+            }
+            else
+            {
+                _recycleBlock(_blocks.takeFirst());
+            }
+        }
+    }
+    return done;
+}
+
+qint64 SshBuffer::skip(qint64 len)
+{
+    return read(NULL, len);
+}
+
+qint64 SshBuffer::trim(qint64 max)
+{
+    qint64 dropped = (_size > max)?(_size - max):(0);
+    if(dropped) skip(dropped);
+    return dropped;
+}
+
+void SshBuffer::clear()
+{
+    while(!_blocks.isEmpty())
+    {
+        _recycleBlock(_blocks.takeFirst());
+    }
+    _head = 0;
+    _tail = 0;
+    _size = 0;
+}
+
+QByteArray SshBuffer::readAll()
+{
+    if(_blocks.size() == 1 && _head == 0 && _tail >= SSHBUFFER_ZEROCOPY)
+    {
+        QByteArray block = _blocks.takeFirst();
+        block.resize(_tail);
+        _tail = 0;
+        _size = 0;
+        return block;
+    }
+
+    QByteArray out;
+    if(_size > 0)
+    {
+        out.resize(int(qMin<qint64>(_size, INT_MAX)));
+        read(out.data(), out.size());
+    }
+    return out;
+}
+
+QList<QByteArray> SshBuffer::readBlocks()
+{
+    QList<QByteArray> out;
+
+    while(_size > 0)
+    {
+        int end = _end();
+        if(_head == 0 && end >= SSHBUFFER_ZEROCOPY)
+        {
+            QByteArray block = _blocks.takeFirst();
+            block.resize(end);
+            out << block;
+            _size -= end;
+        }
+        else
+        {
+            out << QByteArray(_blocks.first().constData() + _head, end - _head);
+            skip(end - _head);
+        }
+        _head = 0;
+    }
+    if(_blocks.isEmpty()) _tail = 0;
+    return out;
+}
+
+QString SshBuffer::readAllText()
+{
+    QString text;
+    QScopedPointer<QTextDecoder> decoder(QTextCodec::codecForMib(106)->makeDecoder());
+
+    /* UTF-8 never takes more QChars than bytes */
+    text.reserve(int(qMin<qint64>(_size, INT_MAX)));
+    while(_size > 0)
+    {
+        int end = _end();
+        text.append(decoder->toUnicode(_blocks.first().constData() + _head, end - _head));
+        skip(end - _head);
+    }
+    return text;
+}
@@ -0,0 +1,49 @@
+#ifndef SSHBUFFER_H
+#define SSHBUFFER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+/*
+ * Byte FIFO made of fixed size blocks taken from a process wide pool.
+ * Channel reads go straight into the free space of the last block
+ * (reserve() then commit()), so growing the buffer never moves the data
+ * already received. Consumers get whole blocks without copy from
+ * readBlocks() ; text is only decoded when readAllText() is called.
+ */
+class SshBuffer
+{
+    QList<QByteArray> _blocks;
+    int _head;
+    int _tail;
+    qint64 _size;
+
+public:
+    SshBuffer();
+    ~SshBuffer();
+
+    qint64 size() const;
+    bool isEmpty() const;
+
+    char *reserve(int &len);
+    void commit(int len);
+
+    qint64 read(char *data, qint64 len);
+    qint64 skip(qint64 len);
+    qint64 trim(qint64 max);
+    void clear();
+    QByteArray readAll();
+    QList<QByteArray> readBlocks();
+    QString readAllText();
+
+private:
+    int _end() const;
+    static QByteArray _allocBlock();
+    static void _recycleBlock(const QByteArray &block);
+
+    SshBuffer(const SshBuffer &);
+    SshBuffer &operator=(const SshBuffer &);
+};
+
+#endif // SSHBUFFER_H
@@ -1,13 +1,13 @@
 #include "sshchannel.h"
 #include "sshclient.h"
 
-SshChannel::SshChannel(QObject *client) : QObject(client)
+SshChannel::SshChannel(QObject *client) : QIODevice(client)
 {
 
 }
 
 SshChannel::SshChannel(SshClient *client) :
-    QObject(client),
+    QIODevice(client),
     sshChannel(NULL),
     sshClient(client)
 {
@@ -21,6 +21,25 @@ SshChannel::~SshChannel()
 {
 }
 
+bool SshChannel::isSequential() const
+{
+    return true;
+}
+
+qint64 SshChannel::readData(char *data, qint64 maxlen)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxlen);
+    return -1;
+}
+
+qint64 SshChannel::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return -1;
+}
+
 void SshChannel::stopChannel()
 {
     if (sshChannel != NULL)
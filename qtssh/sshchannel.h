@@ -1,12 +1,17 @@
 #ifndef SSHCHANNEL_H
 #define SSHCHANNEL_H
 
-#include <QObject>
+#include <QIODevice>
 #include "libssh2.h"
 
 class SshClient;
 
-class SshChannel : public QObject
+/*
+ * Base of every channel driven by SshClient::sshDataReceived. Channels are
+ * sequential devices : the ones carrying a data stream (SshProcess)
+ * implement readData/writeData, the others leave the device closed.
+ */
+class SshChannel : public QIODevice
 {
     Q_OBJECT
 
@@ -18,7 +23,12 @@ public:
     explicit SshChannel(QObject *client);
     explicit SshChannel(SshClient *client);
     virtual ~SshChannel();
-    
+    bool isSequential() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxlen);
+    qint64 writeData(const char *data, qint64 len);
+
 signals:
     void data_rx(qint64 cnt);
     void data_tx(qint64 cnt);
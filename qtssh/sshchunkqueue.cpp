@@ -0,0 +1,63 @@
+#include "sshchunkqueue.h"
+#include <QMutexLocker>
+
+SshChunkQueue::SshChunkQueue(int max):
+    _max(max),
+    _closed(false),
+    _aborted(false)
+{
+}
+
+bool SshChunkQueue::push(const QByteArray &chunk)
+{
+    QMutexLocker lock(&_mutex);
+    while(_chunks.size() >= _max && !_aborted)
+    {
+        _notFull.wait(&_mutex);
+    }
+    if(_aborted || _closed) return false;
+    _chunks.append(chunk);
+    _notEmpty.wakeAll();
+    return true;
+}
+
+bool SshChunkQueue::pop(QByteArray &chunk, unsigned long timeout)
+{
+    QMutexLocker lock(&_mutex);
+    if(_chunks.isEmpty() && !_closed && !_aborted)
+    {
+        _notEmpty.wait(&_mutex, timeout);
+    }
+    if(_chunks.isEmpty() || _aborted) return false;
+    chunk = _chunks.takeFirst();
+    _notFull.wakeAll();
+    return true;
+}
+
+void SshChunkQueue::close()
+{
+    QMutexLocker lock(&_mutex);
+    _closed = true;
+    _notEmpty.wakeAll();
+}
+
+void SshChunkQueue::abort()
+{
+    QMutexLocker lock(&_mutex);
+    _aborted = true;
+    _chunks.clear();
+    _notEmpty.wakeAll();
+    _notFull.wakeAll();
+}
+
+bool SshChunkQueue::atEnd()
+{
+    QMutexLocker lock(&_mutex);
+    return _aborted || (_closed && _chunks.isEmpty());
+}
+
+bool SshChunkQueue::aborted()
+{
+    QMutexLocker lock(&_mutex);
+    return _aborted;
+}
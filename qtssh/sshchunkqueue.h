@@ -0,0 +1,36 @@
+#ifndef SSHCHUNKQUEUE_H
+#define SSHCHUNKQUEUE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <climits>
+
+/*
+ * Bounded queue of data chunks shared between the thread driving the ssh
+ * session and a local producer or consumer thread. push() blocks while the
+ * queue is full, which throttles the fastest side.
+ */
+class SshChunkQueue
+{
+    QMutex _mutex;
+    QWaitCondition _notEmpty;
+    QWaitCondition _notFull;
+    QList<QByteArray> _chunks;
+    int _max;
+    bool _closed;
+    bool _aborted;
+
+public:
+    explicit SshChunkQueue(int max = 16);
+
+    bool push(const QByteArray &chunk);
+    bool pop(QByteArray &chunk, unsigned long timeout = ULONG_MAX);
+    void close();
+    void abort();
+    bool atEnd();
+    bool aborted();
+};
+
+#endif // SSHCHUNKQUEUE_H
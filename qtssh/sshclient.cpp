@@ -3,11 +3,21 @@
 #include <QDir>
 #include <QThread>
 #include <QEventLoop>
+#include <functional>
 #include "sshtunnelin.h"
 #include "sshtunneloutsrv.h"
+#include "sshsockssrv.h"
+#include "sshlocalsocketsrv.h"
 #include "sshprocess.h"
 #include "sshscpsend.h"
+#include "sshscpget.h"
 #include "sshsftp.h"
+#include "sshsftpfollow.h"
+#include "sshmirror.h"
+#include "sshcompressedtransfer.h"
+#include "sshtartransfer.h"
+#include "sshcommand.h"
+#include "sshshell.h"
 
 static ssize_t qt_callback_libssh_recv(int socket,void *buffer, size_t length,int flags, void **abstract)
 {
@@ -48,11 +58,25 @@ SshClient::SshClient(QString name, QObject * parent):
     _session(NULL),
     _knownHosts(0),
     _sftp(NULL),
+    _compressed(NULL),
+    _shell(NULL),
+    _runningCommands(0),
+    _maxChannels(10),
+    _commandTimeout(0),
+    _channelPoolSize(0),
+    _channelPoolRefused(false),
+    _channelPoolOpening(false),
+    _channelOpener(NULL),
     _socket(this),
     _state(NoState),
     _errorcode(0),
     _sshConnected(false),
     _errorMessage(QString()),
+    _cacheHits(0),
+    _cacheMisses(0),
+    _cacheGeneration(0),
+    _connectTimeout(60*1000),
+    _lowDelay(false),
     _cntTxData(0),
     _cntRxData(0)
 {
@@ -60,12 +84,18 @@ SshClient::SshClient(QString name, QObject * parent):
     qDebug() << "DEBUG : SshClient("<< _name << ") : Enter in constructor, @" << this << " in " << QThread::currentThread() << " (" << QThread::currentThreadId() << ")";
 #endif
 
+    _phaseDuration[TcpPhase] = _phaseDuration[KexPhase] = _phaseDuration[AuthPhase] = -1;
     connect(&_socket,   SIGNAL(connected()),                         this, SLOT(_setStateConnected()));
     connect(&_socket,   SIGNAL(disconnected()),                      this, SLOT(_disconnected()));
     connect(&_socket,   SIGNAL(readyRead()),                         this, SLOT(_readyRead()));
     connect(&_socket,   SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(_tcperror(QAbstractSocket::SocketError)));
     connect(&_cntTimer, SIGNAL(timeout()),                           this, SLOT(_cntRate()));
     connect(&_keepalive,SIGNAL(timeout()),                           this, SLOT(_sendKeepAlive()));
+    connect(this,       SIGNAL(connected()),                         this, SLOT(_fillChannelPool()));
+    connect(this,       SIGNAL(sshDataReceived()),                   this, SLOT(_resumeAbandonedOpen()));
+    connect(this,       SIGNAL(sshDataReceived()),                   this, SLOT(_fillChannelPool()));
+    connect(this,       SIGNAL(sshReset()),                          this, SLOT(_clearChannelPool()));
+    connect(this,       SIGNAL(sshReset()),                          this, SLOT(_clearCommandCache()));
 
     Q_ASSERT(libssh2_init(0) == 0);
     _session = libssh2_session_init_ex(NULL, NULL, NULL,reinterpret_cast<void *>(&_socket));
@@ -134,6 +164,75 @@ quint16 SshClient::openRemotePortForwarding(QString servicename, quint16 port)
     return tunnel->localPort();
 }
 
+quint16 SshClient::openDynamicPortForwarding(QString servicename, quint16 bind)
+{
+    if(_channels.contains(servicename))
+    {
+        return _channels.value(servicename)->localPort();
+    }
+
+    SshChannel *proxy = qobject_cast<SshChannel *>(new SshSocksSrv(this, servicename, bind));
+    _channels.insert(servicename, proxy);
+    return proxy->localPort();
+}
+
+bool SshClient::openLocalSocketForwarding(QString servicename, QString localPath, QString host, quint16 port)
+{
+    if(_channels.contains(servicename))
+    {
+        return true;
+    }
+
+    SshLocalSocketSrv *tunnel = new SshLocalSocketSrv(this, servicename, localPath, host, port);
+    _channels.insert(servicename, tunnel);
+    return tunnel->isListening();
+}
+
+bool SshClient::openLocalSocketForwarding(QString servicename, QString localPath, QString remotePath)
+{
+    if(_channels.contains(servicename))
+    {
+        return true;
+    }
+
+    SshLocalSocketSrv *tunnel = new SshLocalSocketSrv(this, servicename, localPath, remotePath);
+    _channels.insert(servicename, tunnel);
+    return tunnel->isListening();
+}
+
+bool SshClient::openRemoteSocketForwarding(QString servicename, quint16 port, QString localPath)
+{
+    if(_channels.contains(servicename))
+    {
+        return true;
+    }
+
+    SshChannel *tunnel = qobject_cast<SshChannel *>(new SshTunnelIn(this, servicename, port, localPath));
+    _channels.insert(servicename, tunnel);
+    return true;
+}
+
+void SshClient::setPortForwardingPoolSize(QString servicename, int count)
+{
+    SshTunnelOutSrv *tunnel = qobject_cast<SshTunnelOutSrv *>(_channels.value(servicename));
+    if(tunnel)
+    {
+        tunnel->setChannelPoolSize(count);
+    }
+}
+
+quint64 SshClient::portForwardingPoolHits(QString servicename) const
+{
+    SshTunnelOutSrv *tunnel = qobject_cast<SshTunnelOutSrv *>(_channels.value(servicename));
+    return (tunnel)?(tunnel->channelPoolHits()):(0);
+}
+
+quint64 SshClient::portForwardingPoolMisses(QString servicename) const
+{
+    SshTunnelOutSrv *tunnel = qobject_cast<SshTunnelOutSrv *>(_channels.value(servicename));
+    return (tunnel)?(tunnel->channelPoolMisses()):(0);
+}
+
 void SshClient::closePortForwarding(QString servicename)
 {
     if(_channels.contains(servicename))
@@ -147,30 +246,473 @@ void SshClient::closePortForwarding(QString servicename)
 QString SshClient::runCommand(QString command)
 {
     QString res;
-    SshProcess *sshProcess = NULL;
-    sshProcess = new SshProcess(this);
-    if(sshProcess != NULL)
+    SshProcess *sshProcess = new SshProcess(this);
+    sshProcess->setTimeout(_commandTimeout);
+    sshProcess->start(command);
+    res = sshProcess->result();
+    delete sshProcess;
+    return res;
+}
+
+SshCommand *SshClient::startCommand(QString command)
+{
+    SshCommand *cmd = new SshCommand(command, this);
+    cmd->setTimeout(_commandTimeout);
+    _pendingCommands.append(cmd);
+    _startPendingCommands();
+    return cmd;
+}
+
+QStringList SshClient::runCommands(QStringList commands)
+{
+    QEventLoop wait;
+    QList<SshCommand *> started;
+    QStringList result;
+    int running = commands.size();
+
+    foreach(QString command, commands)
     {
-        sshProcess->start(command);
-        res = sshProcess->result();
+        SshCommand *cmd = startCommand(command);
+        connect(cmd, &SshCommand::finished, &wait, [&running, &wait](){
+            if(--running == 0) wait.quit();
+        });
+        started << cmd;
     }
-    return res;
+    if(running > 0) wait.exec();
+    foreach(SshCommand *cmd, started)
+    {
+        result << cmd->result();
+        cmd->deleteLater();
+    }
+    return result;
 }
 
-QString SshClient::sendFile(QString src, QString dst)
+void SshClient::setMaxChannels(int count)
+{
+    _maxChannels = qMax(1, count);
+    _startPendingCommands();
+}
+
+int SshClient::maxChannels() const
+{
+    return _maxChannels;
+}
+
+void SshClient::setCommandTimeout(int msecs)
 {
+    _commandTimeout = qMax(0, msecs);
+}
+
+int SshClient::commandTimeout() const
+{
+    return _commandTimeout;
+}
+
+QString SshClient::runCachedCommand(QString command, int ttl)
+{
+    QMap<QString, CachedCommand>::iterator cached = _commandCache.find(command);
+    if(cached != _commandCache.end())
+    {
+        if(!cached->age.hasExpired(cached->ttl))
+        {
+            _cacheHits++;
+            return cached->result;
+        }
+        _commandCache.erase(cached);
+    }
+
+    /* The same command already running for another caller : share its channel */
+    SshCommand *cmd = _inflightCommands.value(command, NULL);
+    if(cmd)
+    {
+        _cacheHits++;
+    }
+    else
+    {
+        _cacheMisses++;
+        cmd = startCommand(command);
+        _inflightCommands.insert(command, cmd);
+        quint64 generation = _cacheGeneration;
+        connect(cmd, &SshCommand::finished, this, [this, cmd, command, ttl, generation](int exitCode){
+            if(_inflightCommands.value(command, NULL) == cmd) _inflightCommands.remove(command);
+            /* Only successful results are kept, a failure is retried next time */
+            if(exitCode == 0 && ttl > 0 && generation == _cacheGeneration)
+            {
+                _evictCachedCommands();
+                CachedCommand &entry = _commandCache[command];
+                entry.result = cmd->result();
+                entry.ttl = ttl;
+                entry.age.start();
+            }
+            cmd->deleteLater();
+        });
+    }
+
+    QString res;
+    if(cmd->isFinished())
+    {
+        return cmd->result();
+    }
     QEventLoop wait;
-    SshScpSend *sender = new SshScpSend(this, src, dst);
-    connect(sender, SIGNAL(transfertTerminate()), &wait, SLOT(quit()));
-    QString d = sender->send();
+    QTimer timeout;
+    bool finished = false;
+    connect(cmd, &SshCommand::finished, &wait, [&res, &wait, &finished, cmd](){
+        res = cmd->result();
+        finished = true;
+        wait.quit();
+    });
+    connect(&timeout, &QTimer::timeout, &wait, &QEventLoop::quit);
+    timeout.setSingleShot(true);
+    timeout.start((_commandTimeout > 0)?(_commandTimeout):(2 * 60 * 1000));
     wait.exec();
+    if(!finished)
+    {
+        qDebug() << "WARNING : SshClient : " << command << " still running, canceled";
+        /* Emits finished(-1) : the entry is dropped, other waiters return too */
+        cmd->cancel();
+        return QString();
+    }
+    return res;
+}
+
+void SshClient::invalidateCommandCache(QString command)
+{
+    /* Commands started before now must not store their result */
+    _cacheGeneration++;
+    if(command.isEmpty())
+    {
+        _commandCache.clear();
+        _inflightCommands.clear();
+    }
+    else
+    {
+        _commandCache.remove(command);
+        _inflightCommands.remove(command);
+    }
+}
+
+void SshClient::_evictCachedCommands()
+{
+    QMap<QString, CachedCommand>::iterator it = _commandCache.begin();
+    while(it != _commandCache.end())
+    {
+        if(it->age.hasExpired(it->ttl)) it = _commandCache.erase(it);
+        else ++it;
+    }
+}
+
+quint64 SshClient::commandCacheHits() const
+{
+    return _cacheHits;
+}
+
+quint64 SshClient::commandCacheMisses() const
+{
+    return _cacheMisses;
+}
+
+double SshClient::commandCacheHitRate() const
+{
+    quint64 total = _cacheHits + _cacheMisses;
+    return (total)?(double(_cacheHits) / double(total)):(0.0);
+}
+
+void SshClient::_clearCommandCache()
+{
+    /* Facts of the previous session may not hold for the next host */
+    _cacheGeneration++;
+    _commandCache.clear();
+    _inflightCommands.clear();
+}
+
+SshShell *SshClient::shell()
+{
+    if(!_shell) _shell = new SshShell(this);
+    return _shell;
+}
+
+void SshClient::setChannelPoolSize(int count)
+{
+    _channelPoolSize = qMax(0, count);
+    while(_channelPool.size() > _channelPoolSize)
+    {
+        LIBSSH2_CHANNEL *channel = _channelPool.takeLast();
+        libssh2_channel_close(channel);
+        libssh2_channel_free(channel);
+    }
+    _fillChannelPool();
+}
+
+void SshClient::setConnectTimeout(int msecs)
+{
+    _connectTimeout = msecs;
+}
+
+void SshClient::setLowDelay(bool enable)
+{
+    _lowDelay = enable;
+    _applyLowDelay();
+}
+
+void SshClient::holdLowDelay(QObject *owner)
+{
+    if(_lowDelayHolders.contains(owner)) return;
+    _lowDelayHolders.append(owner);
+    connect(owner, &QObject::destroyed, this, &SshClient::releaseLowDelay, Qt::UniqueConnection);
+    _applyLowDelay();
+}
+
+void SshClient::releaseLowDelay(QObject *owner)
+{
+    if(_lowDelayHolders.removeAll(owner) == 0) return;
+    disconnect(owner, &QObject::destroyed, this, &SshClient::releaseLowDelay);
+    /* The last pty gone : back to the setting chosen by the user */
+    _applyLowDelay();
+}
+
+void SshClient::_applyLowDelay()
+{
+    if(_socket.state() == QAbstractSocket::ConnectedState)
+    {
+        _socket.setSocketOption(QAbstractSocket::LowDelayOption, (_lowDelay || !_lowDelayHolders.isEmpty())?(1):(0));
+    }
+}
+
+void SshClient::flushSocket()
+{
+    /* Write out what libssh2 queued without waiting for the event loop */
+    _socket.flush();
+}
+
+qint64 SshClient::phaseDuration(ConnectPhase phase) const
+{
+    return _phaseDuration[phase];
+}
+
+int SshClient::channelPoolSize() const
+{
+    return _channelPoolSize;
+}
+
+LIBSSH2_CHANNEL *SshClient::takeChannel()
+{
+    if(_channelPool.isEmpty()) return NULL;
+    LIBSSH2_CHANNEL *channel = _channelPool.takeFirst();
+    /* Refill outside of the caller state machine */
+    _channelPoolRefused = false;
+    QTimer::singleShot(0, this, SLOT(_fillChannelPool()));
+    return channel;
+}
+
+void SshClient::_fillChannelPool()
+{
+    if(_state != ActivatingChannels || _channelPoolRefused) return;
+    /* Pooled channels count against the server MaxSessions like running commands */
+    while(_channelPoolOpening || (_channelPool.size() < _channelPoolSize && _channelPool.size() + _runningCommands < _maxChannels))
+    {
+        if(!lockChannelOpen(this)) return;
+        _channelPoolOpening = true;
+        LIBSSH2_CHANNEL *channel = libssh2_channel_open_session(_session);
+        if(channel == NULL)
+        {
+            if(libssh2_session_last_errno(_session) != LIBSSH2_ERROR_EAGAIN)
+            {
+                /* No more sessions on the server side, retry after the next take */
+#if defined(DEBUG_SSHCLIENT)
+                qDebug() << "DEBUG : SshClient("<< _name << ") : channel pool stays at " << _channelPool.size();
+#endif
+                _channelPoolRefused = true;
+                _channelPoolOpening = false;
+                unlockChannelOpen(this);
+            }
+            return;
+        }
+        _channelPoolOpening = false;
+        unlockChannelOpen(this);
+        if(_channelPool.size() >= _channelPoolSize)
+        {
+            /* The pool was shrunk while this open was pending */
+            libssh2_channel_close(channel);
+            libssh2_channel_free(channel);
+            continue;
+        }
+        _channelPool.append(channel);
+    }
+}
+
+void SshClient::_clearChannelPool()
+{
+    /* Freed with the session, like a pending open */
+    _channelPool.clear();
+    _channelPoolRefused = false;
+    _channelPoolOpening = false;
+    _channelOpener = NULL;
+    _channelOpenWaiters.clear();
+    _channelOpenResume = ChannelOpenResume();
+    _abandonedOpen = ChannelOpenResume();
+}
+
+bool SshClient::lockChannelOpen(QObject *owner, ChannelOpenResume resume)
+{
+    if(_channelOpener == owner)
+    {
+        return true;
+    }
+    /* libssh2 keeps a single pending open per session : first come, first served */
+    if(_channelOpener == NULL && !_abandonedOpen && (_channelOpenWaiters.isEmpty() || _channelOpenWaiters.first() == owner))
+    {
+        _channelOpenWaiters.removeAll(owner);
+        _channelOpener = owner;
+        _channelOpenResume = resume;
+        connect(owner, &QObject::destroyed, this, &SshClient::abandonChannelOpen, Qt::UniqueConnection);
+        return true;
+    }
+    if(!_channelOpenWaiters.contains(owner))
+    {
+        _channelOpenWaiters.append(owner);
+        connect(owner, &QObject::destroyed, this, &SshClient::abandonChannelOpen, Qt::UniqueConnection);
+    }
+    return false;
+}
+
+void SshClient::unlockChannelOpen(QObject *owner)
+{
+    _channelOpenWaiters.removeAll(owner);
+    if(_channelOpener != owner) return;
+    _channelOpener = NULL;
+    _channelOpenResume = ChannelOpenResume();
+    if(!_channelOpenWaiters.isEmpty())
+    {
+        /* Waiters retry on sshDataReceived : don't make them wait for a packet */
+        QTimer::singleShot(0, this, SIGNAL(sshDataReceived()));
+    }
+}
+
+void SshClient::abandonChannelOpen(QObject *owner)
+{
+    _channelOpenWaiters.removeAll(owner);
+    if(_channelOpener != owner) return;
+    /* The half-done open stays in the session : finish it and drop its result */
+    _abandonedOpen = _channelOpenResume;
+    unlockChannelOpen(owner);
+    _resumeAbandonedOpen();
+}
+
+void SshClient::_resumeAbandonedOpen()
+{
+    if(!_abandonedOpen || !_abandonedOpen()) return;
+    _abandonedOpen = ChannelOpenResume();
+    if(!_channelOpenWaiters.isEmpty())
+    {
+        QTimer::singleShot(0, this, SIGNAL(sshDataReceived()));
+    }
+}
+
+void SshClient::_startPendingCommands()
+{
+    while(!_pendingCommands.isEmpty() && _runningCommands < _maxChannels)
+    {
+        SshCommand *cmd = _pendingCommands.takeFirst();
+        if(cmd->isFinished())
+        {
+            /* Canceled while queued */
+            continue;
+        }
+        _runningCommands++;
+        connect(cmd, &SshCommand::finished, this, [this](){
+            _runningCommands--;
+            _startPendingCommands();
+        });
+        connect(cmd, &SshCommand::channelOpenFailed, this, [this, cmd](){
+            disconnect(cmd, 0, this, 0);
+            _runningCommands--;
+            if(_runningCommands > 0)
+            {
+                /* Only emitted when the open was refused : the server
+                 * MaxSessions is lower than ours, stay below it */
+                qDebug() << "WARNING : SshClient : channel refused, max channels lowered to " << _runningCommands;
+                _maxChannels = _runningCommands;
+                _pendingCommands.prepend(cmd);
+            }
+            else
+            {
+                cmd->_finish(-1);
+            }
+        });
+        cmd->_start(this);
+    }
+}
+
+QString SshClient::sendFile(QString src, QString dst)
+{
+    QString d = sendFiles(QStringList() << src, dst).value(0);
 #ifdef DEBUG_SSHCLIENT
-    qDebug() << "DEBUG : Transfert file satus: " << sender->state();
+    qDebug() << "DEBUG : Transfert file satus: " << !d.isEmpty();
 #endif
-    sender->deleteLater();
     return d;
 }
 
+QStringList SshClient::sendFiles(QStringList sources, QString dst)
+{
+    QEventLoop wait;
+    QStringList result;
+    SshScpSend *opening = NULL;
+    int next = 0;
+    int running = 0;
+    std::function<void()> launch;
+
+    for(int i = 0; i < sources.size(); ++i) result << QString();
+
+    /* Transfers run concurrently, but channels are opened one at a time */
+    launch = [&]() {
+        opening = NULL;
+        while(next < sources.size() && opening == NULL)
+        {
+            int index = next++;
+            SshScpSend *sender = new SshScpSend(this, sources.at(index), dst);
+            result[index] = sender->send();
+            if(result[index].isEmpty())
+            {
+                sender->deleteLater();
+                continue;
+            }
+            running++;
+            opening = sender;
+            connect(sender, &SshScpSend::channelOpened, &wait, [&, sender](){
+                if(opening == sender) launch();
+            });
+            connect(sender, &SshScpSend::transfertTerminate, &wait, [&, sender, index](){
+                if(!sender->state()) result[index].clear();
+                sender->deleteLater();
+                running--;
+                if(opening == sender) launch();
+                if(running == 0 && next >= sources.size()) wait.quit();
+            });
+        }
+    };
+    launch();
+    if(running > 0) wait.exec();
+    return result;
+}
+
+bool SshClient::getFile(QString src, QString dst)
+{
+    QEventLoop wait;
+    SshScpGet *receiver = new SshScpGet(this, src, dst);
+    connect(receiver, &SshScpGet::transfertTerminate, &wait, &QEventLoop::quit);
+    bool ret = receiver->get();
+    if(ret)
+    {
+        wait.exec();
+        ret = receiver->state();
+    }
+#ifdef DEBUG_SSHCLIENT
+    qDebug() << "DEBUG : Receive file satus: " << ret;
+#endif
+    receiver->deleteLater();
+    return ret;
+}
+
 void SshClient::enableSFTP()
 {
     if(!_sftp)
@@ -185,6 +727,50 @@ void SshClient::enableSFTP()
     }
 }
 
+SshSFtp *SshClient::sftp()
+{
+    enableSFTP();
+    return _sftp;
+}
+
+SshSFtpFollow *SshClient::follow(QString path, bool fromStart)
+{
+    enableSFTP();
+    SshSFtpFollow *follower = new SshSFtpFollow(_sftp, path, fromStart);
+    follower->start();
+    return follower;
+}
+
+bool SshClient::mirror(QString localDir, QString remoteDir, int direction)
+{
+    SshMirror engine(this);
+    return engine.mirror(localDir, remoteDir, SshMirror::Direction(direction));
+}
+
+QString SshClient::sendCompressed(QString source, QString dest)
+{
+    if(!_compressed) _compressed = new SshCompressedTransfer(this);
+    return _compressed->send(source, dest);
+}
+
+bool SshClient::getCompressed(QString source, QString dest, bool override)
+{
+    if(!_compressed) _compressed = new SshCompressedTransfer(this);
+    return _compressed->get(source, dest, override);
+}
+
+bool SshClient::getDirectory(QString remoteDir, QString localDir)
+{
+    SshTarTransfer transfer(this);
+    return transfer.get(remoteDir, localDir);
+}
+
+bool SshClient::sendDirectory(QString localDir, QString remoteDir)
+{
+    SshTarTransfer transfer(this);
+    return transfer.send(localDir, remoteDir);
+}
+
 QString SshClient::send(QString source, QString dest)
 {
     QString res;
@@ -280,7 +866,9 @@ int SshClient::connectToHost(const QString & user, const QString & host, quint16
     qDebug() << "DEBUG : SshClient("<< _name << ") : trying to connect to host (" << _hostname << ":" << _port << ")";
 #endif
 
-    timeout.setInterval(60*1000);
+    timeout.setInterval(_connectTimeout);
+    _phaseDuration[TcpPhase] = _phaseDuration[KexPhase] = _phaseDuration[AuthPhase] = -1;
+    _phaseTimer.start();
     auto c1 = connect(this, SIGNAL(_connectionTerminate()), &wait, SLOT(quit()));
     auto c2 = connect(&_socket, static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError err)>(&QAbstractSocket::error), [this, &wait, &failed](QAbstractSocket::SocketError err){
         if(err == QAbstractSocket::RemoteHostClosedError)
@@ -440,6 +1028,8 @@ void SshClient::_setStateConnected()
 #if defined(DEBUG_SSHCLIENT)
     qDebug() << "DEBUG : SshClient("<< _name << ") : ssh socket connected";
 #endif
+    _phaseDuration[TcpPhase] = _phaseTimer.restart();
+    if(_lowDelay || !_lowDelayHolders.isEmpty()) _socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
     _state = InitializeSession;
     _readyRead();
     _sshConnected = true;
@@ -503,6 +1093,7 @@ void SshClient::_readyRead()
                 askDisconnect();
                 return;
             }
+            _phaseDuration[KexPhase] = _phaseTimer.restart();
             size_t len;
             int type;
             const char * fingerprint = libssh2_session_hostkey(_session, &len, &type);
@@ -640,6 +1231,7 @@ void SshClient::_readyRead()
             {
                 _state = ActivatingChannels;
                 _errorcode = LIBSSH2_ERROR_NONE;
+                _phaseDuration[AuthPhase] = _phaseTimer.restart();
 #if defined(DEBUG_SSHCLIENT) || defined(DEBUG_THREAD)
     qDebug() << "DEBUG : SshClient("<< _name << ") : Connected, @" << this << " in " << QThread::currentThread() << " (" << QThread::currentThreadId() << ")";
 #endif
@@ -3,8 +3,12 @@
 
 #include <QObject>
 #include <QList>
+#include <QMap>
+#include <QStringList>
 #include <QTcpSocket>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <functional>
 #include "sshchannel.h"
 #include "sshfsinterface.h"
 #include "sshinterface.h"
@@ -15,6 +19,10 @@ extern "C" {
 }
 
 class SshSFtp;
+class SshSFtpFollow;
+class SshCompressedTransfer;
+class SshCommand;
+class SshShell;
 
 
 
@@ -43,7 +51,21 @@ private:
     LIBSSH2_SESSION    * _session;
     LIBSSH2_KNOWNHOSTS * _knownHosts;
     SshSFtp            *_sftp;
+    SshCompressedTransfer *_compressed;
+    SshShell           *_shell;
     QMap<QString,SshChannel*>   _channels;
+    QList<SshCommand*> _pendingCommands;
+    int _runningCommands;
+    int _maxChannels;
+    int _commandTimeout;
+    QList<LIBSSH2_CHANNEL*> _channelPool;
+    int _channelPoolSize;
+    bool _channelPoolRefused;
+    bool _channelPoolOpening;
+    QObject *_channelOpener;
+    QList<QObject*> _channelOpenWaiters;
+    std::function<bool()> _channelOpenResume;
+    std::function<bool()> _abandonedOpen;
     QTcpSocket _socket;
 
     SshState _state;
@@ -67,17 +89,44 @@ private:
     QList<SshClient::AuthenticationMethod> _availableMethods;
     QList<SshClient::AuthenticationMethod> _failedMethods;
 
+    struct CachedCommand {
+        QString result;
+        QElapsedTimer age;
+        int ttl;
+    };
+    QMap<QString, CachedCommand> _commandCache;
+    QMap<QString, SshCommand*> _inflightCommands;
+    quint64 _cacheHits;
+    quint64 _cacheMisses;
+    quint64 _cacheGeneration;
+
+    QElapsedTimer _phaseTimer;
+    qint64 _phaseDuration[3];
+    int _connectTimeout;
+    bool _lowDelay;
+    QList<QObject *> _lowDelayHolders;
+
     qint64 _cntTxData;
     qint64 _cntRxData;
     QTimer _cntTimer;
     QTimer _keepalive;
 
 public:
+    enum ConnectPhase {
+        TcpPhase,
+        KexPhase,
+        AuthPhase
+    };
+
+    /* Continues a pending open without its owner, true once it is over */
+    typedef std::function<bool()> ChannelOpenResume;
+
     SshClient(QString name = "noname", QObject * parent = NULL);
     virtual ~SshClient();
 
 /* <<<SshInterface>>> */
 public slots:
+    /* retry is the number of attempts after the first one, 0 connects once */
     int connectToHost(const QString & username, const QString & hostname, quint16 port = 22, bool lock = true, bool checkHostKey = false, unsigned int retry = 5);
     void disconnectFromHost();
     QString runCommand(QString command);
@@ -93,6 +142,40 @@ public slots:
     QString banner();
 /* >>>SshInterface<<< */
 
+    quint16 openDynamicPortForwarding(QString servicename, quint16 bind = 0);
+    bool openLocalSocketForwarding(QString servicename, QString localPath, QString host, quint16 port);
+    bool openLocalSocketForwarding(QString servicename, QString localPath, QString remotePath);
+    bool openRemoteSocketForwarding(QString servicename, quint16 port, QString localPath);
+    void setPortForwardingPoolSize(QString servicename, int count);
+    quint64 portForwardingPoolHits(QString servicename) const;
+    quint64 portForwardingPoolMisses(QString servicename) const;
+    QStringList sendFiles(QStringList sources, QString dst);
+    bool getFile(QString src, QString dst);
+    SshCommand *startCommand(QString command);
+    QStringList runCommands(QStringList commands);
+    void setMaxChannels(int count);
+    int maxChannels() const;
+    void setCommandTimeout(int msecs);
+    int commandTimeout() const;
+    /*
+     * Result of a successful run kept for ttl ms. The wait is bounded by
+     * the command timeout (2 minutes when none) : the command is canceled
+     * and an empty result returned. Results of commands still running when
+     * the cache is invalidated are not stored.
+     */
+    QString runCachedCommand(QString command, int ttl = 5 * 60 * 1000);
+    void invalidateCommandCache(QString command = QString());
+    quint64 commandCacheHits() const;
+    quint64 commandCacheMisses() const;
+    double commandCacheHitRate() const;
+    SshShell *shell();
+    void setChannelPoolSize(int count);
+    int channelPoolSize() const;
+    void setConnectTimeout(int msecs);
+    /* TCP_NODELAY while enabled or while any holder (an open pty) remains */
+    void setLowDelay(bool enable);
+    qint64 phaseDuration(ConnectPhase phase) const;
+
 /* <<<SshFsInterface>>> */
 public slots:
     void enableSFTP();
@@ -108,11 +191,37 @@ public slots:
 /* >>>SshFsInterface<<< */
 
 
+    SshSFtp *sftp();
+    SshSFtpFollow *follow(QString path, bool fromStart = false);
+    /* direction is a SshMirror::Direction, Upload by default */
+    bool mirror(QString localDir, QString remoteDir, int direction = 0);
+    QString sendCompressed(QString source, QString dest);
+    bool getCompressed(QString source, QString dest, bool override = false);
+    bool getDirectory(QString remoteDir, QString localDir);
+    bool sendDirectory(QString localDir, QString remoteDir);
+
     LIBSSH2_SESSION *session();
     bool channelReady();
     bool waitForBytesWritten(int msecs);
     bool getSshConnected() const;
 
+/* Used by the channels of this client : not slots */
+public:
+    LIBSSH2_CHANNEL *takeChannel();
+    /*
+     * libssh2 keeps the state of a pending channel open in the session, so
+     * opens must not overlap. Call lockChannelOpen() before every attempt
+     * and unlockChannelOpen() once the open succeeded or failed. An owner
+     * going away mid-open calls abandonChannelOpen() (done on destroyed())
+     * and the session finishes the open with the resume function.
+     */
+    bool lockChannelOpen(QObject *owner, ChannelOpenResume resume = ChannelOpenResume());
+    void unlockChannelOpen(QObject *owner);
+    void abandonChannelOpen(QObject *owner);
+    void holdLowDelay(QObject *owner);
+    void releaseLowDelay(QObject *owner);
+    void flushSocket();
+
 
 signals:
     void connected();
@@ -139,6 +248,15 @@ private slots:
     void _tcperror(QAbstractSocket::SocketError err);
     void _cntRate();
     void _sendKeepAlive();
+    void _startPendingCommands();
+    void _fillChannelPool();
+    void _clearChannelPool();
+    void _resumeAbandonedOpen();
+    void _clearCommandCache();
+
+private:
+    void _evictCachedCommands();
+    void _applyLowDelay();
 };
 
 #endif
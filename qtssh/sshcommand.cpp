@@ -0,0 +1,154 @@
+#include "sshcommand.h"
+#include "sshclient.h"
+#include "sshprocess.h"
+#include "sshshell.h"
+#include <QEventLoop>
+#include <QTimer>
+#include <QDebug>
+
+SshCommand::SshCommand(QString command, QObject *parent):
+    QObject(parent),
+    _command(command),
+    _process(NULL),
+    _shell(NULL),
+    _exitCode(-1),
+    _finished(false),
+    _timeout(0),
+    _timedOut(false)
+{
+    _deadline.setSingleShot(true);
+    QObject::connect(&_deadline, &QTimer::timeout, this, [this](){
+        if(_finished || !_shell) return;
+        _timedOut = true;
+        _shell->_timedOut(this);
+    });
+}
+
+SshCommand::~SshCommand()
+{
+    /* Deleted while its shell still waits for it */
+    if(_shell && !_finished) _shell->_drop(this);
+    delete _process;
+}
+
+QString SshCommand::command() const
+{
+    return _command;
+}
+
+QByteArray SshCommand::output() const
+{
+    return _output;
+}
+
+QByteArray SshCommand::errorOutput() const
+{
+    return _errorOutput;
+}
+
+QString SshCommand::result() const
+{
+    return QString(_output);
+}
+
+int SshCommand::exitCode() const
+{
+    return _exitCode;
+}
+
+bool SshCommand::isFinished() const
+{
+    return _finished;
+}
+
+bool SshCommand::waitForFinished(int msecs)
+{
+    if(_finished) return true;
+
+    QEventLoop loop;
+    QTimer timer;
+    QObject::connect(this, &SshCommand::finished, &loop, &QEventLoop::quit);
+    QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+    if(msecs >= 0)
+    {
+        timer.setSingleShot(true);
+        timer.start(msecs);
+    }
+    loop.exec();
+    return _finished;
+}
+
+void SshCommand::setTimeout(int msecs)
+{
+    _timeout = msecs;
+    if(_process) _process->setTimeout(msecs);
+    if(_shell && !_finished)
+    {
+        if(msecs > 0) _deadline.start(msecs);
+        else _deadline.stop();
+    }
+}
+
+bool SshCommand::isTimedOut() const
+{
+    return _timedOut;
+}
+
+void SshCommand::cancel()
+{
+    if(_finished) return;
+    if(_process)
+    {
+        /* Emits finished(-1) through the process */
+        _process->cancel();
+    }
+    else if(_shell)
+    {
+        /* Its sentinels will be skipped by the shell */
+        _shell->_drop(this);
+        _finish(-1);
+    }
+    else
+    {
+        /* Still queued in the client : never started */
+        _finish(-1);
+    }
+}
+
+void SshCommand::_start(SshClient *client)
+{
+    _process = new SshProcess(client);
+    _process->setTimeout(_timeout);
+    QObject::connect(_process, &SshProcess::readyReadStandardOutput, this, [this](){
+        _output.append(_process->readAllStandardOutput());
+    });
+    QObject::connect(_process, &SshProcess::readyReadStandardError, this, [this](){
+        _errorOutput.append(_process->readAllStandardError());
+    });
+    QObject::connect(_process, &SshProcess::finished, this, [this](int exitCode){
+        _output.append(_process->readAllStandardOutput());
+        _errorOutput.append(_process->readAllStandardError());
+        _timedOut = _process->isTimedOut();
+        _process->deleteLater();
+        _process = NULL;
+        _finish(exitCode);
+    });
+    QObject::connect(_process, &SshProcess::channelOpenFailed, this, [this](){
+        _process->deleteLater();
+        _process = NULL;
+        emit channelOpenFailed();
+    });
+    _process->start(_command);
+}
+
+void SshCommand::_finish(int exitCode)
+{
+    if(_finished) return;
+    _deadline.stop();
+#if defined(DEBUG_SSHCHANNEL)
+    qDebug() << "DEBUG : SshCommand : " << _command << " exited with " << exitCode;
+#endif
+    _exitCode = exitCode;
+    _finished = true;
+    emit finished(exitCode);
+}
@@ -0,0 +1,69 @@
+#ifndef SSHCOMMAND_H
+#define SSHCOMMAND_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QTimer>
+
+class SshClient;
+class SshProcess;
+class SshShell;
+
+/*
+ * One command started with SshClient::startCommand(). Commands run
+ * concurrently, each on its own channel, up to SshClient::maxChannels() :
+ * the others wait in the client queue. finished() is emitted with the whole
+ * output collected. A command running longer than its timeout, or canceled,
+ * finishes with exit code -1 and the output received so far. finished() is
+ * emitted once.
+ *
+ * A command of an SshShell that times out (counted from SshShell::run(),
+ * the client commandTimeout() by default) restarts the shell : the commands
+ * queued behind it finish with -1 too. A canceled shell command is dropped
+ * but keeps running in the shell until it returns.
+ */
+class SshCommand : public QObject
+{
+    Q_OBJECT
+
+    friend class SshClient;
+    friend class SshShell;
+
+    QString _command;
+    SshProcess *_process;
+    SshShell *_shell;
+    QTimer _deadline;
+    QByteArray _output;
+    QByteArray _errorOutput;
+    int _exitCode;
+    bool _finished;
+    int _timeout;
+    bool _timedOut;
+
+public:
+    explicit SshCommand(QString command, QObject *parent = NULL);
+    virtual ~SshCommand();
+
+    QString command() const;
+    QByteArray output() const;
+    QByteArray errorOutput() const;
+    QString result() const;
+    int exitCode() const;
+    bool isFinished() const;
+    bool waitForFinished(int msecs = -1);
+    void setTimeout(int msecs);
+    bool isTimedOut() const;
+
+public slots:
+    void cancel();
+
+signals:
+    void finished(int exitCode);
+    void channelOpenFailed();
+
+private:
+    void _start(SshClient *client);
+    void _finish(int exitCode);
+};
+
+#endif // SSHCOMMAND_H
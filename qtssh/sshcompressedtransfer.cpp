@@ -0,0 +1,466 @@
+#include "sshcompressedtransfer.h"
+#include "sshclient.h"
+#include "sshprocess.h"
+#include "sshchunkqueue.h"
+#include "sshutils.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QTimer>
+#include <QEventLoop>
+#include <QAtomicInteger>
+#include <QDebug>
+#include <string.h>
+#include <zlib.h>
+#if defined(QTSSH_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+#define COMPRESS_SAMPLE_LEN (256 * 1024)
+#define COMPRESS_BUFFER_LEN (256 * 1024)
+
+class SshStreamCodec
+{
+public:
+    virtual ~SshStreamCodec() {}
+    virtual bool process(const char *data, qint64 len, QByteArray &out, bool finish) = 0;
+    static SshStreamCodec *create(SshCompressedTransfer::Codec codec, bool compress);
+};
+
+class SshGzipCodec : public SshStreamCodec
+{
+    z_stream _z;
+    bool _compress;
+    bool _valid;
+    QByteArray _buffer;
+
+public:
+    explicit SshGzipCodec(bool compress):
+        _compress(compress),
+        _buffer(COMPRESS_BUFFER_LEN, 0)
+    {
+        memset(&_z, 0, sizeof(_z));
+        if(_compress) _valid = (deflateInit2(&_z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        else _valid = (inflateInit2(&_z, 15 + 32) == Z_OK);
+    }
+
+    ~SshGzipCodec()
+    {
+        if(!_valid) return;
+        if(_compress) deflateEnd(&_z);
+        else inflateEnd(&_z);
+    }
+
+    bool process(const char *data, qint64 len, QByteArray &out, bool finish)
+    {
+        int ret;
+        if(!_valid) return false;
+
+        _z.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        _z.avail_in = uInt(len);
+        do {
+            _z.next_out  = reinterpret_cast<Bytef *>(_buffer.data());
+            _z.avail_out = uInt(_buffer.size());
+            if(_compress)
+            {
+                ret = deflate(&_z, (finish)?(Z_FINISH):(Z_NO_FLUSH));
+            }
+            else
+            {
+                ret = inflate(&_z, Z_NO_FLUSH);
+                if(ret == Z_STREAM_END && _z.avail_in > 0)
+                {
+                    /* Concatenated gzip members */
+                    inflateReset(&_z);
+                    ret = Z_OK;
+                }
+            }
+            if(ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_NEED_DICT)
+            {
+                return false;
+            }
+            out.append(_buffer.constData(), _buffer.size() - int(_z.avail_out));
+            if(ret == Z_BUF_ERROR) break;
+        } while(_z.avail_out == 0 || _z.avail_in > 0 || (_compress && finish && ret != Z_STREAM_END));
+        return true;
+    }
+};
+
+#if defined(QTSSH_WITH_ZSTD)
+class SshZstdCodec : public SshStreamCodec
+{
+    ZSTD_CCtx *_cctx;
+    ZSTD_DCtx *_dctx;
+    QByteArray _buffer;
+
+public:
+    explicit SshZstdCodec(bool compress):
+        _cctx((compress)?(ZSTD_createCCtx()):(NULL)),
+        _dctx((compress)?(NULL):(ZSTD_createDCtx())),
+        _buffer(int((compress)?(ZSTD_CStreamOutSize()):(ZSTD_DStreamOutSize())), 0)
+    {
+    }
+
+    ~SshZstdCodec()
+    {
+        if(_cctx) ZSTD_freeCCtx(_cctx);
+        if(_dctx) ZSTD_freeDCtx(_dctx);
+    }
+
+    bool process(const char *data, qint64 len, QByteArray &out, bool finish)
+    {
+        ZSTD_inBuffer in = { data, size_t(len), 0 };
+        ZSTD_outBuffer o;
+        size_t ret;
+
+        do {
+            o.dst  = _buffer.data();
+            o.size = size_t(_buffer.size());
+            o.pos  = 0;
+            if(_cctx) ret = ZSTD_compressStream2(_cctx, &o, &in, (finish)?(ZSTD_e_end):(ZSTD_e_continue));
+            else ret = ZSTD_decompressStream(_dctx, &o, &in);
+            if(ZSTD_isError(ret)) return false;
+            out.append(_buffer.constData(), int(o.pos));
+        } while(in.pos < in.size || o.pos == o.size || (_cctx && finish && ret != 0));
+        return true;
+    }
+};
+#endif
+
+SshStreamCodec *SshStreamCodec::create(SshCompressedTransfer::Codec codec, bool compress)
+{
+    switch(codec)
+    {
+    case SshCompressedTransfer::GzipCodec:
+        return new SshGzipCodec(compress);
+#if defined(QTSSH_WITH_ZSTD)
+    case SshCompressedTransfer::ZstdCodec:
+        return new SshZstdCodec(compress);
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/* Decompress the chunks received from the channel into the local file */
+class SshInflateWorker : public QThread
+{
+public:
+    SshStreamCodec *codec;
+    SshChunkQueue *queue;
+    QFile file;
+    QAtomicInteger<qint64> written;
+    bool failed;
+
+    SshInflateWorker(SshCompressedTransfer::Codec c, QString dest, SshChunkQueue *q):
+        codec(SshStreamCodec::create(c, false)),
+        queue(q),
+        file(dest),
+        written(0),
+        failed(false)
+    {
+    }
+
+    ~SshInflateWorker()
+    {
+        delete codec;
+    }
+
+    void run()
+    {
+        QByteArray chunk, out;
+        while(!queue->atEnd())
+        {
+            if(!queue->pop(chunk, 100)) continue;
+            out.clear();
+            if(!codec->process(chunk.constData(), chunk.size(), out, false) || file.write(out) != out.size())
+            {
+                failed = true;
+                queue->abort();
+                break;
+            }
+            written.fetchAndAddRelaxed(out.size());
+        }
+        file.close();
+    }
+};
+
+/* Compress the local file into chunks sent on the channel */
+class SshDeflateWorker : public QThread
+{
+public:
+    SshStreamCodec *codec;
+    SshChunkQueue *queue;
+    QFile file;
+    QAtomicInteger<qint64> read;
+    bool failed;
+
+    SshDeflateWorker(SshCompressedTransfer::Codec c, QString source, SshChunkQueue *q):
+        codec(SshStreamCodec::create(c, true)),
+        queue(q),
+        file(source),
+        read(0),
+        failed(false)
+    {
+    }
+
+    ~SshDeflateWorker()
+    {
+        delete codec;
+    }
+
+    void run()
+    {
+        QByteArray in(COMPRESS_BUFFER_LEN, 0), out;
+        while(true)
+        {
+            qint64 len = file.read(in.data(), in.size());
+            out.clear();
+            if(len < 0 || !codec->process(in.constData(), len, out, len == 0))
+            {
+                failed = true;
+                break;
+            }
+            read.fetchAndAddRelaxed(len);
+            if(!out.isEmpty() && !queue->push(out)) break;
+            if(len == 0) break;
+        }
+        file.close();
+        if(failed) queue->abort();
+        else queue->close();
+    }
+};
+
+SshCompressedTransfer::SshCompressedTransfer(SshClient *client):
+    QObject(client),
+    _client(client),
+    _probed(false),
+    _codec(NoCodec),
+    _lastCodec(NoCodec),
+    _maxRatio(0.8),
+    _minSize(64 * 1024)
+{
+}
+
+void SshCompressedTransfer::setMaxRatio(double ratio)
+{
+    _maxRatio = ratio;
+}
+
+void SshCompressedTransfer::setMinSize(qint64 size)
+{
+    _minSize = size;
+}
+
+SshCompressedTransfer::Codec SshCompressedTransfer::lastCodec() const
+{
+    return _lastCodec;
+}
+
+SshCompressedTransfer::Codec SshCompressedTransfer::_remoteCodec()
+{
+    if(!_probed)
+    {
+        QString tools = _client->runCommand("command -v zstd >/dev/null 2>&1 && echo zstd; command -v gzip >/dev/null 2>&1 && echo gzip");
+#if defined(QTSSH_WITH_ZSTD)
+        if(tools.contains("zstd")) _codec = ZstdCodec;
+        else
+#endif
+        if(tools.contains("gzip")) _codec = GzipCodec;
+        else _codec = NoCodec;
+        _probed = true;
+    }
+    return _codec;
+}
+
+QString SshCompressedTransfer::_compressCommand(Codec codec)
+{
+    return (codec == ZstdCodec)?("zstd -c -q"):("gzip -c");
+}
+
+QString SshCompressedTransfer::_decompressCommand(Codec codec)
+{
+    return (codec == ZstdCodec)?("zstd -d -c -q"):("gzip -d -c");
+}
+
+bool SshCompressedTransfer::get(QString source, QString dest, bool override)
+{
+    _lastCodec = NoCodec;
+    if(dest.endsWith("/"))
+    {
+        dest += QFileInfo(source).fileName();
+    }
+
+    Codec codec = _remoteCodec();
+    qint64 size = 0;
+    if(codec != NoCodec)
+    {
+        /* Size of the file and compressed size of its head in one round trip */
+        QString quoted = shellQuote(source);
+        QStringList probe = _client->runCommand(QString("stat -c %s -- %1 && head -c %2 -- %1 | %3 | wc -c")
+                                                .arg(quoted).arg(COMPRESS_SAMPLE_LEN).arg(_compressCommand(codec)))
+                                                .split("\n", SSH_SKIP_EMPTY_PARTS);
+        size = (probe.size() >= 2)?(probe[0].trimmed().toLongLong()):(0);
+        qint64 sample = qMin<qint64>(size, COMPRESS_SAMPLE_LEN);
+        if(size < _minSize || sample <= 0 || double(probe[1].trimmed().toLongLong()) / sample > _maxRatio)
+        {
+            codec = NoCodec;
+        }
+    }
+    if(codec == NoCodec || (!override && QFile::exists(dest)))
+    {
+        return _client->get(source, dest, override);
+    }
+
+    SshChunkQueue queue(64);
+    SshInflateWorker worker(codec, dest, &queue);
+    if(!worker.file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "ERROR : Can't open file " << dest;
+        return false;
+    }
+    worker.start();
+
+    SshProcess *proc = new SshProcess(_client);
+    QEventLoop loop;
+    QTimer idle;
+    QByteArray buffer(COMPRESS_BUFFER_LEN, 0);
+    qint64 wire = 0;
+    bool failed = false;
+
+    idle.setSingleShot(true);
+    idle.setInterval(2 * 60 * 1000);
+    QObject::connect(&idle, &QTimer::timeout, &loop, [&loop, &failed](){
+        failed = true;
+        loop.quit();
+    });
+    auto drain = [&](){
+        qint64 len;
+        while((len = proc->read(buffer.data(), buffer.size())) > 0)
+        {
+            if(!queue.push(QByteArray(buffer.constData(), int(len))))
+            {
+                failed = true;
+                loop.quit();
+                return;
+            }
+            wire += len;
+            idle.start();
+        }
+        emit progress(wire, worker.written.load());
+        if(proc->isEOF()) loop.quit();
+    };
+    QObject::connect(proc, &SshProcess::readyRead, &loop, drain);
+    QObject::connect(proc, &SshProcess::readChannelFinished, &loop, drain);
+    proc->start(QString("%1 -- %2").arg(_compressCommand(codec)).arg(shellQuote(source)));
+    idle.start();
+    loop.exec();
+    idle.stop();
+
+    queue.close();
+    worker.wait();
+    delete proc;
+
+    if(failed || worker.failed || worker.written.load() != size)
+    {
+        qDebug() << "WARNING : SshCompressedTransfer : compressed get of " << source << " failed, fallback to sftp";
+        return _client->get(source, dest, true);
+    }
+#if defined(DEBUG_SFTP)
+    qDebug() << "DEBUG : SshCompressedTransfer : get " << source << " : " << wire << " bytes for " << size;
+#endif
+    _lastCodec = codec;
+    return true;
+}
+
+QString SshCompressedTransfer::send(QString source, QString dest)
+{
+    _lastCodec = NoCodec;
+    QFileInfo src(source);
+    if(dest.endsWith("/"))
+    {
+        if(!_client->isDir(dest))
+        {
+            _client->mkpath(dest);
+        }
+        dest += src.fileName();
+    }
+
+    Codec codec = _remoteCodec();
+    if(codec != NoCodec)
+    {
+        /* Compress the head of the file to decide if it is worth it */
+        QFile sample(source);
+        SshStreamCodec *probe = SshStreamCodec::create(codec, true);
+        QByteArray in, out;
+        if(src.size() >= _minSize && sample.open(QIODevice::ReadOnly))
+        {
+            in = sample.read(COMPRESS_SAMPLE_LEN);
+        }
+        if(in.isEmpty() || !probe || !probe->process(in.constData(), in.size(), out, true) || double(out.size()) / in.size() > _maxRatio)
+        {
+            codec = NoCodec;
+        }
+        delete probe;
+    }
+    if(codec == NoCodec)
+    {
+        return _client->send(source, dest);
+    }
+
+    SshChunkQueue queue(16);
+    SshDeflateWorker worker(codec, source, &queue);
+    if(!worker.file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "ERROR : Can't open file " << source;
+        return "";
+    }
+
+    SshProcess *proc = new SshProcess(_client);
+    proc->start(QString("%1 > %2 && echo QTSSH_OK").arg(_decompressCommand(codec)).arg(shellQuote(dest)));
+    worker.start();
+
+    QByteArray chunk;
+    qint64 wire = 0;
+    bool failed = !proc->waitForStarted();
+    if(failed) queue.abort();
+    while(!failed && !queue.atEnd())
+    {
+        if(!queue.pop(chunk, 100)) continue;
+        if(proc->write(chunk.constData(), chunk.size()) != chunk.size())
+        {
+            failed = true;
+            queue.abort();
+            break;
+        }
+        wire += chunk.size();
+        emit progress(wire, worker.read.load());
+        /* Keep the channel write queue short : the remote window paces the producer */
+        while(!failed && proc->bytesToWrite() > 4 * COMPRESS_BUFFER_LEN)
+        {
+            failed = !proc->waitForBytesWritten(60000);
+        }
+        /* The worker may be blocked on the full queue */
+        if(failed) queue.abort();
+    }
+    worker.wait();
+    QString res;
+    if(failed) proc->cancel();
+    else
+    {
+        proc->closeWriteChannel();
+        res = proc->result();
+    }
+    delete proc;
+
+    if(failed || worker.failed || !res.contains("QTSSH_OK"))
+    {
+        qDebug() << "WARNING : SshCompressedTransfer : compressed send of " << source << " failed, fallback to sftp";
+        return _client->send(source, dest);
+    }
+#if defined(DEBUG_SFTP)
+    qDebug() << "DEBUG : SshCompressedTransfer : send " << source << " : " << wire << " bytes for " << src.size();
+#endif
+    _lastCodec = codec;
+    return dest;
+}
@@ -0,0 +1,56 @@
+#ifndef SSHCOMPRESSEDTRANSFER_H
+#define SSHCOMPRESSEDTRANSFER_H
+
+#include <QObject>
+#include <QStringList>
+
+class SshClient;
+
+/*
+ * Transfer a file through a remote compressor running on an exec channel :
+ * "gzip -c" (or "zstd -c" when built with zstd) for downloads, decompressed
+ * locally on a worker thread, and the reverse for uploads.
+ *
+ * A sample of the file is compressed first : when the remote tool is missing,
+ * the file is small or the data does not compress, the transfer falls back to
+ * plain SFTP.
+ */
+class SshCompressedTransfer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Codec {
+        NoCodec,
+        GzipCodec,
+        ZstdCodec
+    };
+
+private:
+    SshClient *_client;
+    bool _probed;
+    Codec _codec;
+    Codec _lastCodec;
+    double _maxRatio;
+    qint64 _minSize;
+
+public:
+    explicit SshCompressedTransfer(SshClient *client);
+
+    void setMaxRatio(double ratio);
+    void setMinSize(qint64 size);
+    Codec lastCodec() const;
+
+    bool get(QString source, QString dest, bool override = false);
+    QString send(QString source, QString dest);
+
+signals:
+    void progress(qint64 wire, qint64 plain);
+
+private:
+    Codec _remoteCodec();
+    static QString _compressCommand(Codec codec);
+    static QString _decompressCommand(Codec codec);
+};
+
+#endif // SSHCOMPRESSEDTRANSFER_H
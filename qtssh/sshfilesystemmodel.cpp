@@ -1,5 +1,7 @@
 #include "sshfilesystemmodel.h"
 #include "sshfilesystemnode.h"
+#include "sshremotewatcher.h"
+#include <QFileInfo>
 #include <qdebug.h>
 
 SshFilesystemModel::SshFilesystemModel(SshFsInterface *provider):
@@ -80,3 +82,43 @@ QHash<int, QByteArray> SshFilesystemModel::roleNames() const
 {
     return _roles;
 }
+
+void SshFilesystemModel::refresh(const QString &path)
+{
+    SshFilesystemNode *node = _rootItem->find(path);
+    if(!node)
+    {
+        /* Outside of the model root */
+        return;
+    }
+
+    /* Only the rows of the changed node are replaced, the rest of the tree stays */
+    QModelIndex index = (node == _rootItem)?(QModelIndex()):(createIndex(node->row(), 0, node));
+    int rows = node->childCount();
+    if(rows > 0)
+    {
+        beginRemoveRows(index, 0, rows - 1);
+        node->unload();
+        endRemoveRows();
+    }
+    QStringList entries = node->list();
+    if(!entries.isEmpty())
+    {
+        beginInsertRows(index, 0, entries.size() - 1);
+        node->setEntries(entries);
+        endInsertRows();
+    }
+    if(index.isValid())
+    {
+        emit dataChanged(index, index.sibling(index.row(), node->columnCount() - 1));
+    }
+}
+
+void SshFilesystemModel::setWatcher(SshRemoteWatcher *watcher)
+{
+    QObject::connect(watcher, &SshRemoteWatcher::changed, this, [this](QString path, SshRemoteWatcher::ChangeType type){
+        /* The parent listing changes on add/remove, the node itself on modify */
+        if(type == SshRemoteWatcher::Modified) refresh(path);
+        else refresh(QFileInfo(path).path());
+    });
+}
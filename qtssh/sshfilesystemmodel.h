@@ -7,6 +7,7 @@
 #include "sshfsinterface.h"
 
 class SshFilesystemNode;
+class SshRemoteWatcher;
 
 class SshFilesystemModel : public QAbstractItemModel
 {
@@ -34,6 +35,8 @@ public:
     QHash<int, QByteArray> roleNames() const;
 
     void setRootPath(QString root = "/");
+    void refresh(const QString &path);
+    void setWatcher(SshRemoteWatcher *watcher);
 };
 
 #endif // SSHFILESYSTEMMODEL_H
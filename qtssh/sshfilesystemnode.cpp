@@ -1,4 +1,5 @@
 #include "sshfilesystemnode.h"
+#include "sshutils.h"
 #include <qdebug.h>
 #include <QTime>
 
@@ -18,18 +19,82 @@ SshFilesystemNode::SshFilesystemNode(SshFsInterface *provider, SshFilesystemNode
 #if defined(DEBUG_SSHFILESYSTEMNODE)
     qDebug() << "Create FileSystemNode " << this << " with path = " << this->path();
 #endif
+    reload();
+}
+
+void SshFilesystemNode::reload()
+{
+    unload();
+    setEntries(list());
+}
+
+void SshFilesystemNode::unload()
+{
+    qDeleteAll(_dirchildren);
+    qDeleteAll(_filechildren);
+    _dirchildren.clear();
+    _filechildren.clear();
+    _readdir.clear();
+    _expended = false;
+}
+
+QStringList SshFilesystemNode::list()
+{
+    QStringList entries;
+
+    /* Attributes are updated now, the children only by setEntries() */
     _isdir = _provider->isDir(this->path());
     if(_isdir)
     {
-        _readdir.append(_provider->readdir(this->path()));
-        _readdir.removeAll(".");
-        _readdir.removeAll("..");
+        entries = _provider->readdir(this->path());
+        entries.removeAll(".");
+        entries.removeAll("..");
         _filesize = 0;
     }
     else
     {
         _filesize = _provider->filesize(this->path());
     }
+    return entries;
+}
+
+void SshFilesystemNode::setEntries(const QStringList &entries)
+{
+    _readdir = entries;
+}
+
+SshFilesystemNode *SshFilesystemNode::find(const QString &path)
+{
+    SshFilesystemNode *node = this;
+    QString root = this->path();
+    QString relative = path;
+
+    /* Paths are absolute, names below this node start after its own path */
+    while(root.length() > 1 && root.endsWith("/")) root.chop(1);
+    if(root != "/")
+    {
+        if(relative == root) return this;
+        if(!relative.startsWith(root + "/")) return nullptr;
+        relative = relative.mid(root.length());
+    }
+    foreach(QString name, relative.split("/", SSH_SKIP_EMPTY_PARTS))
+    {
+        /* Children not created yet : this node is the deepest one to reload */
+        if(!node->_expended) return node;
+
+        SshFilesystemNode *next = nullptr;
+        foreach(SshFilesystemNode *child, node->_dirchildren + node->_filechildren)
+        {
+            if(child->_filename == name)
+            {
+                next = child;
+                break;
+            }
+        }
+        if(!next) return node;
+        node = next;
+    }
+    return node;
 }
 
 SshFilesystemNode *SshFilesystemNode::child(int row)
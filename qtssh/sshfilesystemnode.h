@@ -31,7 +31,11 @@ public:
     QVariant data(int column) const;
     int childId(const SshFilesystemNode *) const;
     int row() const;
-
+    SshFilesystemNode *find(const QString &path);
+    void reload();
+    void unload();
+    QStringList list();
+    void setEntries(const QStringList &entries);
 
 
     bool isdir() const;
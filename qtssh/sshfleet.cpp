@@ -0,0 +1,266 @@
+#include "sshfleet.h"
+#include "sshclient.h"
+#include "sshprocess.h"
+#include <QRunnable>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <math.h>
+#include <algorithm>
+
+/* Handle one host in a pool thread : its own client, nested loops are local */
+class SshFleetJob : public QRunnable
+{
+public:
+    SshFleet *fleet;
+    QAtomicInt *aborted;
+    SshFleet::Host host;
+    QString command;
+    QString publicKey;
+    QString privateKey;
+    QString passphrase;
+    int connectTimeout;
+    int commandTimeout;
+    int retries;
+    bool retryCommands;
+
+    void run()
+    {
+        SshFleet::Result result;
+        result.hostname = host.hostname;
+        result.ok = false;
+        result.exitCode = -1;
+        result.attempts = 0;
+
+        bool retry = true;
+        for(int attempt = 0; attempt <= retries && retry && !aborted->load(); ++attempt)
+        {
+            for(int i = 0; i < 4; ++i) result.duration[i] = -1;
+            result.attempts = attempt + 1;
+            result.output.clear();
+            result.errorOutput.clear();
+            retry = _attempt(result);
+        }
+        if(result.attempts == 0) result.error = "aborted";
+        QMetaObject::invokeMethod(fleet, "_hostDone", Qt::QueuedConnection, Q_ARG(SshFleet::Result, result));
+    }
+
+private:
+    /* Returns whether another attempt may be made */
+    bool _attempt(SshFleet::Result &result)
+    {
+        SshClient client(host.hostname);
+        client.setKeys(publicKey, privateKey);
+        if(!passphrase.isEmpty()) client.setPassphrase(passphrase);
+        client.setConnectTimeout(connectTimeout);
+        client.setChannelPoolSize(0);
+
+        /* retry counts attempts after the first one : 0 connects once */
+        int err = client.connectToHost(host.user, host.hostname, host.port, true, false, 0);
+        result.duration[SshFleet::TcpPhase]  = client.phaseDuration(SshClient::TcpPhase);
+        result.duration[SshFleet::KexPhase]  = client.phaseDuration(SshClient::KexPhase);
+        result.duration[SshFleet::AuthPhase] = client.phaseDuration(SshClient::AuthPhase);
+        if(err != 0)
+        {
+            result.error = QString("connection failed (%1)").arg(err);
+            return true;
+        }
+
+        QElapsedTimer exec;
+        QEventLoop loop;
+        SshProcess *proc = new SshProcess(&client);
+        QObject::connect(proc, &SshProcess::readyReadStandardOutput, &loop, [&result, proc](){
+            result.output.append(proc->readAllStandardOutput());
+        });
+        QObject::connect(proc, &SshProcess::readyReadStandardError, &loop, [&result, proc](){
+            result.errorOutput.append(proc->readAllStandardError());
+        });
+        bool refused = false;
+        QObject::connect(proc, &SshProcess::finished, &loop, &QEventLoop::quit);
+        QObject::connect(proc, &SshProcess::channelOpenFailed, &loop, [&loop, &refused](){
+            refused = true;
+            loop.quit();
+        });
+        /* A stuck host is canceled at the deadline, the thread goes on with the next one */
+        proc->setTimeout(commandTimeout);
+        exec.start();
+        proc->start(command);
+        loop.exec();
+
+        /* The command never reached the host : safe to try again */
+        bool retry = refused;
+        if(proc->isTimedOut())
+        {
+            result.output.append(proc->readAllStandardOutput());
+            result.errorOutput.append(proc->readAllStandardError());
+            result.error = "command timeout";
+            retry = retryCommands;
+        }
+        else if(proc->hasExitStatus())
+        {
+            result.output.append(proc->readAllStandardOutput());
+            result.errorOutput.append(proc->readAllStandardError());
+            result.exitCode = proc->exitStatus();
+            result.duration[SshFleet::ExecPhase] = exec.elapsed();
+            result.error.clear();
+            result.ok = true;
+        }
+        else
+        {
+            /* Exec or pty refused, channel lost : the command may have run */
+            result.output.append(proc->readAllStandardOutput());
+            result.errorOutput.append(proc->readAllStandardError());
+            result.error = proc->errorString();
+            if(!refused) retry = retryCommands;
+        }
+        delete proc;
+        client.disconnectFromHost();
+        return retry && !result.ok;
+    }
+};
+
+SshFleet::SshFleet(QObject *parent):
+    QObject(parent),
+    _connectTimeout(30*1000),
+    _commandTimeout(60*1000),
+    _retries(1),
+    _retryCommands(false),
+    _pending(0),
+    _aborted(0)
+{
+    qRegisterMetaType<SshFleet::Result>();
+    _pool.setMaxThreadCount(32);
+}
+
+SshFleet::~SshFleet()
+{
+    abort();
+    _pool.waitForDone();
+}
+
+void SshFleet::setKeys(const QString &publicKey, const QString &privateKey)
+{
+    _publicKey  = publicKey;
+    _privateKey = privateKey;
+}
+
+void SshFleet::setPassphrase(const QString &pass)
+{
+    _passphrase = pass;
+}
+
+void SshFleet::setMaxConnections(int count)
+{
+    _pool.setMaxThreadCount(qMax(1, count));
+}
+
+int SshFleet::maxConnections() const
+{
+    return _pool.maxThreadCount();
+}
+
+void SshFleet::setConnectTimeout(int msecs)
+{
+    _connectTimeout = msecs;
+}
+
+void SshFleet::setCommandTimeout(int msecs)
+{
+    _commandTimeout = msecs;
+}
+
+void SshFleet::setRetries(int count)
+{
+    _retries = qMax(0, count);
+}
+
+void SshFleet::setRetryCommands(bool idempotent)
+{
+    _retryCommands = idempotent;
+}
+
+void SshFleet::run(const QList<Host> &hosts, QString command)
+{
+    _aborted.store(0);
+    foreach(Host host, hosts)
+    {
+        SshFleetJob *job = new SshFleetJob;
+        job->fleet          = this;
+        job->aborted        = &_aborted;
+        job->host           = host;
+        job->command        = command;
+        job->publicKey      = _publicKey;
+        job->privateKey     = _privateKey;
+        job->passphrase     = _passphrase;
+        job->connectTimeout = _connectTimeout;
+        job->commandTimeout = _commandTimeout;
+        job->retries        = _retries;
+        job->retryCommands  = _retryCommands;
+        _pending++;
+        _pool.start(job);
+    }
+    if(_pending == 0) emit finished();
+}
+
+void SshFleet::abort()
+{
+    /* Queued hosts are reported as failed without connecting */
+    _aborted.store(1);
+}
+
+bool SshFleet::isRunning() const
+{
+    return _pending > 0;
+}
+
+bool SshFleet::waitForFinished(int msecs)
+{
+    if(_pending == 0) return true;
+
+    QEventLoop loop;
+    QTimer timer;
+    QObject::connect(this, &SshFleet::finished, &loop, &QEventLoop::quit);
+    QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+    if(msecs >= 0)
+    {
+        timer.setSingleShot(true);
+        timer.start(msecs);
+    }
+    loop.exec();
+    return _pending == 0;
+}
+
+QList<SshFleet::Result> SshFleet::results() const
+{
+    return _results;
+}
+
+qint64 SshFleet::percentile(Phase phase, double p) const
+{
+    QList<qint64> values = _durations[phase];
+    if(values.isEmpty()) return -1;
+    std::sort(values.begin(), values.end());
+    int rank = int(ceil(p / 100.0 * values.size())) - 1;
+    return values.at(qBound(0, rank, values.size() - 1));
+}
+
+void SshFleet::_hostDone(SshFleet::Result result)
+{
+    for(int i = TcpPhase; i <= ExecPhase; ++i)
+    {
+        if(result.duration[i] >= 0) _durations[i].append(result.duration[i]);
+    }
+    _results.append(result);
+    _pending--;
+#if defined(DEBUG_SSHCLIENT)
+    qDebug() << "DEBUG : SshFleet : " << result.hostname << (result.ok?"done":"failed") << result.error << " (" << _pending << " left)";
+#endif
+    emit hostFinished(result);
+    if(_pending == 0)
+    {
+#if defined(DEBUG_SSHCLIENT)
+        qDebug() << "DEBUG : SshFleet : exec p50=" << percentile(ExecPhase, 50) << "ms p99=" << percentile(ExecPhase, 99) << "ms";
+#endif
+        emit finished();
+    }
+}
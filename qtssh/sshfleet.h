@@ -0,0 +1,97 @@
+#ifndef SSHFLEET_H
+#define SSHFLEET_H
+
+#include <QObject>
+#include <QList>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QMetaType>
+
+/*
+ * Run one command on many hosts. Each host is handled by a job of a shared
+ * thread pool (connect, exec, disconnect, with retries) : at most
+ * maxConnections() hosts are in flight. Results are delivered as each host
+ * completes, and the durations of every phase are kept to find slow hosts.
+ *
+ * A result is ok when the command returned an exit status, whatever its
+ * value. Only connection and channel open failures are retried : a command
+ * that timed out or lost its channel may have run already, it is retried
+ * only after setRetryCommands(true), for idempotent commands.
+ */
+class SshFleet : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Phase {
+        TcpPhase,
+        KexPhase,
+        AuthPhase,
+        ExecPhase
+    };
+
+    struct Host {
+        QString user;
+        QString hostname;
+        quint16 port;
+
+        Host(QString u = QString(), QString h = QString(), quint16 p = 22):
+            user(u), hostname(h), port(p) {}
+    };
+
+    struct Result {
+        QString hostname;
+        bool ok;
+        int exitCode;
+        int attempts;
+        QByteArray output;
+        QByteArray errorOutput;
+        QString error;
+        qint64 duration[4];
+    };
+
+private:
+    QThreadPool _pool;
+    QString _publicKey;
+    QString _privateKey;
+    QString _passphrase;
+    int _connectTimeout;
+    int _commandTimeout;
+    int _retries;
+    bool _retryCommands;
+    int _pending;
+    QAtomicInt _aborted;
+    QList<Result> _results;
+    QList<qint64> _durations[4];
+
+public:
+    explicit SshFleet(QObject *parent = NULL);
+    virtual ~SshFleet();
+
+    void setKeys(const QString &publicKey, const QString &privateKey);
+    void setPassphrase(const QString &pass);
+    void setMaxConnections(int count);
+    int maxConnections() const;
+    void setConnectTimeout(int msecs);
+    void setCommandTimeout(int msecs);
+    void setRetries(int count);
+    void setRetryCommands(bool idempotent);
+
+    void run(const QList<Host> &hosts, QString command);
+    void abort();
+    bool isRunning() const;
+    bool waitForFinished(int msecs = -1);
+    QList<Result> results() const;
+    qint64 percentile(Phase phase, double p) const;
+
+signals:
+    void hostFinished(const SshFleet::Result &result);
+    void finished();
+
+private slots:
+    void _hostDone(SshFleet::Result result);
+};
+
+Q_DECLARE_METATYPE(SshFleet::Result)
+
+#endif // SSHFLEET_H
@@ -0,0 +1,121 @@
+#include "sshlocalsocketsrv.h"
+#include "sshtunnelout.h"
+#include "sshclient.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QDir>
+#include <QFile>
+#include <sys/stat.h>
+
+/* A socket file nobody listens on anymore, left by a crashed process */
+static bool staleSocket(const QString &name)
+{
+    /* Relative names live in the temp dir, like QLocalServer puts them */
+    QString path = (QDir::isAbsolutePath(name))?(name):(QDir::tempPath() + "/" + name);
+    struct stat st;
+    if(::lstat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISSOCK(st.st_mode))
+    {
+        return false;
+    }
+    QLocalSocket probe;
+    probe.connectToServer(path);
+    bool alive = probe.waitForConnected(1000);
+    probe.abort();
+    return !alive;
+}
+
+SshLocalSocketSrv::SshLocalSocketSrv(SshClient *client, QString port_identifier, QString localPath, QString host, quint16 port):
+    SshChannel(client),
+    _sshclient(client),
+    _identifier(port_identifier),
+    _host(host),
+    _port(port),
+    _count(0)
+{
+    _listen(localPath);
+}
+
+SshLocalSocketSrv::SshLocalSocketSrv(SshClient *client, QString port_identifier, QString localPath, QString remotePath):
+    SshChannel(client),
+    _sshclient(client),
+    _identifier(port_identifier),
+    _port(0),
+    _remotePath(remotePath),
+    _count(0)
+{
+    _listen(localPath);
+}
+
+SshLocalSocketSrv::~SshLocalSocketSrv()
+{
+    foreach (SshTunnelOut *tunnel, _connections) {
+        tunnel->deleteLater();
+    }
+    _localserver->close();
+    _localserver->deleteLater();
+}
+
+void SshLocalSocketSrv::_listen(QString localPath)
+{
+    _localserver = new QLocalServer(this);
+    /* Only the owner may connect, like a tcp forward bound to 127.0.0.1 */
+    _localserver->setSocketOptions(QLocalServer::UserAccessOption);
+    /* A stale socket would make listen() fail, a live one or any other file is kept */
+    if(staleSocket(localPath))
+    {
+        QLocalServer::removeServer(localPath);
+    }
+    if(!_localserver->listen(localPath))
+    {
+        qDebug() << "ERROR : SshLocalSocketSrv(" << _identifier << ") : cannot listen on " << localPath << " : " << _localserver->errorString();
+    }
+    connect(_localserver, SIGNAL(newConnection()), this, SLOT  (createConnection()));
+}
+
+bool SshLocalSocketSrv::isListening() const
+{
+    return _localserver->isListening();
+}
+
+QString SshLocalSocketSrv::localPath() const
+{
+    return _localserver->fullServerName();
+}
+
+void SshLocalSocketSrv::createConnection()
+{
+    while(_localserver->hasPendingConnections())
+    {
+        QLocalSocket *socket = _localserver->nextPendingConnection();
+
+        if(!_sshclient->channelReady())
+        {
+            qDebug() << "WARNING : SshLocalSocketSrv cannot open channel before connected()";
+            socket->deleteLater();
+            continue;
+        }
+
+        QString name = QString("%1_%2").arg(_identifier).arg(++_count);
+        SshTunnelOut *tunnel = (_remotePath.isEmpty())
+                ?(new SshTunnelOut(_sshclient, socket, name, _host, _port))
+                :(new SshTunnelOut(_sshclient, socket, name, _remotePath));
+        connect(tunnel, SIGNAL(disconnected()), this, SLOT(connectionDisconnected()));
+        _connections.append(tunnel);
+    }
+}
+
+void SshLocalSocketSrv::connectionDisconnected()
+{
+    SshTunnelOut *tunnel = (SshTunnelOut *)QObject::sender();
+    if(tunnel == NULL)
+        return;
+    _connections.removeAll(tunnel);
+    tunnel->deleteLater();
+}
+
+void SshLocalSocketSrv::sshDataReceived()
+{
+    foreach (SshTunnelOut *tunnel, _connections) {
+        tunnel->sshDataReceived();
+    }
+}
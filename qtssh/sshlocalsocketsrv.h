@@ -0,0 +1,45 @@
+#ifndef SSHLOCALSOCKETSRV_H
+#define SSHLOCALSOCKETSRV_H
+
+#include <QObject>
+#include "sshchannel.h"
+
+class QLocalServer;
+class SshTunnelOut;
+class SshClient;
+
+/*
+ * Local unix socket forward. Every connection accepted on the local path
+ * goes to a remote tcp host and port through direct-tcpip, or to a remote
+ * unix socket through direct-streamlocal when a remote path is given.
+ */
+class SshLocalSocketSrv : public SshChannel
+{
+    Q_OBJECT
+
+    QLocalServer            *_localserver;
+    QList<SshTunnelOut*>    _connections;
+    SshClient               *_sshclient;
+    QString                 _identifier;
+    QString                 _host;
+    quint16                 _port;
+    QString                 _remotePath;
+    int                     _count;
+
+public:
+    explicit SshLocalSocketSrv(SshClient * client, QString port_identifier, QString localPath, QString host, quint16 port);
+    explicit SshLocalSocketSrv(SshClient * client, QString port_identifier, QString localPath, QString remotePath);
+    ~SshLocalSocketSrv();
+    bool isListening() const;
+    QString localPath() const;
+    void sshDataReceived();
+
+public slots:
+    void createConnection();
+    void connectionDisconnected();
+
+private:
+    void _listen(QString localPath);
+};
+
+#endif // SSHLOCALSOCKETSRV_H
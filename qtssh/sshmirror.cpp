@@ -0,0 +1,409 @@
+#include "sshmirror.h"
+#include "sshclient.h"
+#include "sshsftp.h"
+#include "sshutils.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QThread>
+#include <QCryptographicHash>
+#include <QDebug>
+
+#define MIRROR_MANIFEST_MAGIC (0x51534d32)
+
+static QDataStream &operator<<(QDataStream &out, const SshMirror::Entry &entry)
+{
+    out << entry.size << entry.mtime << entry.isDir << entry.hash;
+    return out;
+}
+
+static QDataStream &operator>>(QDataStream &in, SshMirror::Entry &entry)
+{
+    in >> entry.size >> entry.mtime >> entry.isDir >> entry.hash;
+    return in;
+}
+
+static QString joinPath(const QString &dir, const QString &relative)
+{
+    return (dir.endsWith("/"))?(dir + relative):(dir + "/" + relative);
+}
+
+/* Any change inside a directory invalidates its mtime for the next pruned scan */
+static void touchParents(SshMirror::Manifest &manifest, QString path)
+{
+    int sep;
+    while((sep = path.lastIndexOf('/')) > 0)
+    {
+        path.truncate(sep);
+        if(manifest.contains(path)) manifest[path].mtime = 0;
+    }
+}
+
+class SshMirrorLocalScan : public QThread
+{
+public:
+    QString root;
+    QString exclude;
+    SshMirror::Manifest result;
+
+    void run()
+    {
+        scan(root, QString());
+    }
+
+    void scan(const QString &dir, const QString &relative)
+    {
+        QDir d(dir);
+        foreach(QFileInfo info, d.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System, QDir::Name))
+        {
+            /* Leftovers of an interrupted transfer are not part of the tree */
+            if(info.isSymLink() || info.absoluteFilePath() == exclude || info.fileName().endsWith(SFTP_TEMP_SUFFIX)) continue;
+
+            QString rel = (relative.isEmpty())?(info.fileName()):(relative + "/" + info.fileName());
+            SshMirror::Entry entry;
+            entry.isDir = info.isDir();
+            entry.size  = (entry.isDir)?(0):(info.size());
+            entry.mtime = info.lastModified().toMSecsSinceEpoch() / 1000;
+            result.insert(rel, entry);
+            if(entry.isDir)
+            {
+                scan(info.absoluteFilePath(), rel);
+            }
+        }
+    }
+};
+
+SshMirror::SshMirror(SshClient *client):
+    QObject(client),
+    _client(client),
+    _sftp(client->sftp()),
+    _hashCompare(false),
+    _fullScan(false),
+    _pruneScan(false),
+    _fullScanEvery(10),
+    _runs(0),
+    _parallel(4)
+{
+}
+
+void SshMirror::setManifestFile(QString file)
+{
+    _manifestFile = file;
+}
+
+void SshMirror::setHashCompare(bool enable)
+{
+    _hashCompare = enable;
+}
+
+void SshMirror::setFullScan(bool enable)
+{
+    _fullScan = enable;
+}
+
+void SshMirror::setFullScanEvery(int runs)
+{
+    _fullScanEvery = runs;
+}
+
+void SshMirror::setParallelTransfers(int count)
+{
+    _parallel = count;
+}
+
+bool SshMirror::mirror(QString localDir, QString remoteDir, Direction direction)
+{
+    localDir = QDir(localDir).absolutePath();
+    while(remoteDir.length() > 1 && remoteDir.endsWith("/"))
+    {
+        remoteDir.chop(1);
+    }
+    QString manifestFile = (_manifestFile.isEmpty())?(joinPath(localDir, ".qtsshmirror")):(_manifestFile);
+
+    _previousLocal.clear();
+    _previousRemote.clear();
+    _runs = 0;
+    QFile in(manifestFile);
+    if(in.open(QIODevice::ReadOnly))
+    {
+        QDataStream stream(&in);
+        quint32 magic;
+        QString storedLocal, storedRemote;
+        stream >> magic >> storedLocal >> storedRemote;
+        if(magic == MIRROR_MANIFEST_MAGIC && storedLocal == localDir && storedRemote == remoteDir)
+        {
+            stream >> _runs >> _previousLocal >> _previousRemote;
+        }
+    }
+
+    /* Pruned scans miss files edited in place : list everything now and then */
+    _runs++;
+    _pruneScan = !_fullScan && (_fullScanEvery <= 0 || (_runs % quint32(_fullScanEvery)) != 0);
+
+    /* Local tree is scanned on a thread while the remote one is listed */
+    SshMirrorLocalScan localScan;
+    localScan.root = localDir;
+    localScan.exclude = QFileInfo(manifestFile).absoluteFilePath();
+    localScan.start();
+
+    Manifest remote;
+    if(_sftp->isDir(remoteDir))
+    {
+        _scanRemote(remoteDir, QString(), remote);
+    }
+    else
+    {
+        _sftp->mkpath(remoteDir);
+    }
+    localScan.wait();
+    Manifest local = localScan.result;
+
+    /* Compute the actions */
+    QStringList mkRemote, mkLocal, uploads, downloads, rmRemote, rmLocal;
+    QMap<QString, bool> paths;
+    foreach(QString path, local.keys()) paths.insert(path, true);
+    foreach(QString path, remote.keys()) paths.insert(path, true);
+
+    foreach(QString path, paths.keys())
+    {
+        bool hasLocal  = local.contains(path);
+        bool hasRemote = remote.contains(path);
+        /* Entries synchronized on last run : a missing side has been deleted */
+        bool wasSynced = _previousLocal.contains(path) && _previousRemote.contains(path);
+
+        if(hasLocal && hasRemote)
+        {
+            Entry &l = local[path];
+            Entry &r = remote[path];
+            if(l.isDir != r.isDir)
+            {
+                qDebug() << "WARNING : SshMirror : type conflict on " << path << ", skipped";
+                continue;
+            }
+            if(l.isDir || _same(path, l, r, localDir, remoteDir)) continue;
+
+            if(direction == Upload || (direction == Bidirectional && l.mtime >= r.mtime)) uploads << path;
+            else downloads << path;
+        }
+        else if(hasLocal)
+        {
+            const Entry &l = local[path];
+            bool deleted = (direction == Download)
+                        || (direction == Bidirectional && wasSynced && _previousLocal[path].mtime == l.mtime && _previousLocal[path].size == l.size);
+            if(deleted) rmLocal << path;
+            else if(l.isDir) mkRemote << path;
+            else uploads << path;
+        }
+        else
+        {
+            const Entry &r = remote[path];
+            bool deleted = (direction == Upload)
+                        || (direction == Bidirectional && wasSynced && _previousRemote[path].mtime == r.mtime && _previousRemote[path].size == r.size);
+            if(deleted) rmRemote << path;
+            else if(r.isDir) mkLocal << path;
+            else downloads << path;
+        }
+    }
+
+    int total = mkRemote.size() + mkLocal.size() + uploads.size() + downloads.size() + rmRemote.size() + rmLocal.size();
+    int done = 0;
+    bool res = true;
+#if defined(DEBUG_SFTP)
+    qDebug() << "DEBUG : SshMirror : " << uploads.size() << " uploads, " << downloads.size() << " downloads, "
+             << rmRemote.size() << " remote deletes, " << rmLocal.size() << " local deletes";
+#endif
+    emit progress(done, total);
+
+    /* Directories first (keys are sorted, parents come before children) */
+    foreach(QString path, mkRemote)
+    {
+        _sftp->mkpath(joinPath(remoteDir, path));
+        remote.insert(path, local[path]);
+        remote[path].mtime = 0;
+        touchParents(remote, path);
+    }
+    foreach(QString path, mkLocal)
+    {
+        QDir().mkpath(joinPath(localDir, path));
+        local.insert(path, remote[path]);
+        local[path].mtime = 0;
+        touchParents(local, path);
+    }
+    done += mkRemote.size() + mkLocal.size();
+    emit progress(done, total);
+
+    /* Pipelined transfers */
+    QList<SshSFtpTransfer> jobs;
+    foreach(QString path, uploads)
+    {
+        SshSFtpTransfer job;
+        job.direction = SshSFtpTransfer::Upload;
+        job.local  = joinPath(localDir, path);
+        job.remote = joinPath(remoteDir, path);
+        job.mtime  = local[path].mtime;
+        job.ok     = false;
+        jobs.append(job);
+    }
+    foreach(QString path, downloads)
+    {
+        SshSFtpTransfer job;
+        job.direction = SshSFtpTransfer::Download;
+        job.local  = joinPath(localDir, path);
+        job.remote = joinPath(remoteDir, path);
+        job.mtime  = remote[path].mtime;
+        job.ok     = false;
+        jobs.append(job);
+    }
+    res = _sftp->transfer(jobs, _parallel) && res;
+    for(int i = 0; i < jobs.size(); ++i)
+    {
+        bool upload = (jobs[i].direction == SshSFtpTransfer::Upload);
+        QString path = (upload)?(uploads[i]):(downloads[i - uploads.size()]);
+        if(!jobs[i].ok)
+        {
+            /* Forget the destination so it is compared again on next run */
+            if(upload) remote.remove(path);
+            else local.remove(path);
+            continue;
+        }
+        if(upload)
+        {
+            remote.insert(path, local[path]);
+            touchParents(remote, path);
+        }
+        else
+        {
+            local.insert(path, remote[path]);
+            touchParents(local, path);
+        }
+    }
+    done += jobs.size();
+    emit progress(done, total);
+
+    /* Deletes, children before their parent directory */
+    for(int i = rmRemote.size() - 1; i >= 0; --i)
+    {
+        const QString &path = rmRemote[i];
+        QString target = joinPath(remoteDir, path);
+        /* unlink() returns true on error */
+        bool removed = (remote[path].isDir)?(_sftp->rmdir(target)):(!_sftp->unlink(target));
+        res = removed && res;
+        /* A failed delete stays in the manifest : the file is still there */
+        if(!removed) continue;
+        remote.remove(path);
+        touchParents(remote, path);
+    }
+    for(int i = rmLocal.size() - 1; i >= 0; --i)
+    {
+        const QString &path = rmLocal[i];
+        QString target = joinPath(localDir, path);
+        bool removed = (local[path].isDir)?(QDir().rmdir(target)):(QFile::remove(target));
+        res = removed && res;
+        if(!removed) continue;
+        local.remove(path);
+        touchParents(local, path);
+    }
+    done += rmRemote.size() + rmLocal.size();
+    emit progress(done, total);
+
+    /* Persist the manifests for the next run */
+    QFile out(manifestFile);
+    if(out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        QDataStream stream(&out);
+        stream << quint32(MIRROR_MANIFEST_MAGIC) << localDir << remoteDir << _runs << local << remote;
+    }
+    else
+    {
+        qDebug() << "WARNING : SshMirror : can't save manifest " << manifestFile;
+    }
+    return res;
+}
+
+void SshMirror::_scanRemote(const QString &root, const QString &relative, Manifest &result)
+{
+    QString dir = (relative.isEmpty())?(root):(joinPath(root, relative));
+    QMap<QString, LIBSSH2_SFTP_ATTRIBUTES> list = _sftp->readdirAttributes(dir);
+
+    for(QMap<QString, LIBSSH2_SFTP_ATTRIBUTES>::const_iterator it = list.constBegin(); it != list.constEnd(); ++it)
+    {
+        if(it.key().endsWith(SFTP_TEMP_SUFFIX)) continue;
+        QString rel = (relative.isEmpty())?(it.key()):(relative + "/" + it.key());
+        Entry entry;
+        entry.isDir = LIBSSH2_SFTP_S_ISDIR(it->permissions);
+        entry.size  = (entry.isDir)?(0):(it->filesize);
+        entry.mtime = it->mtime;
+        if(!entry.isDir && !LIBSSH2_SFTP_S_ISREG(it->permissions)) continue;
+        result.insert(rel, entry);
+
+        if(entry.isDir) _scanRemoteDir(root, rel, entry.mtime, result);
+    }
+}
+
+void SshMirror::_scanRemoteDir(const QString &root, const QString &relative, quint64 mtime, Manifest &result)
+{
+    Manifest::const_iterator old = _previousRemote.constFind(relative);
+    if(!_pruneScan || old == _previousRemote.constEnd() || !old->isDir || !old->mtime || old->mtime != mtime)
+    {
+        _scanRemote(root, relative, result);
+        return;
+    }
+
+    /* Unchanged directory : reuse its direct entries, stat and walk its subdirectories */
+    QString sub = relative + "/";
+    for(Manifest::const_iterator o = _previousRemote.lowerBound(sub); o != _previousRemote.constEnd() && o.key().startsWith(sub); ++o)
+    {
+        if(o.key().indexOf('/', sub.length()) >= 0) continue;
+        Entry entry = o.value();
+        if(entry.isDir)
+        {
+            LIBSSH2_SFTP_ATTRIBUTES attrs;
+            if(!_sftp->stat(joinPath(root, o.key()), attrs)) continue;
+            entry.mtime = attrs.mtime;
+            result.insert(o.key(), entry);
+            _scanRemoteDir(root, o.key(), entry.mtime, result);
+        }
+        else
+        {
+            result.insert(o.key(), entry);
+        }
+    }
+}
+
+bool SshMirror::_same(const QString &path, Entry &local, Entry &remote, const QString &localDir, const QString &remoteDir)
+{
+    if(local.size != remote.size) return false;
+    if(local.mtime == remote.mtime) return true;
+    if(!_hashCompare) return false;
+
+    /* Hashes of the previous run are still valid when size and mtime did not move */
+    Manifest::const_iterator pl = _previousLocal.constFind(path);
+    if(pl != _previousLocal.constEnd() && pl->size == local.size && pl->mtime == local.mtime) local.hash = pl->hash;
+    Manifest::const_iterator pr = _previousRemote.constFind(path);
+    if(pr != _previousRemote.constEnd() && pr->size == remote.size && pr->mtime == remote.mtime) remote.hash = pr->hash;
+
+    if(local.hash.isEmpty()) local.hash = _localHash(joinPath(localDir, path));
+    if(remote.hash.isEmpty()) remote.hash = _remoteHash(joinPath(remoteDir, path));
+    return !local.hash.isEmpty() && local.hash == remote.hash;
+}
+
+QByteArray SshMirror::_localHash(const QString &file)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    QFile f(file);
+    if(!f.open(QIODevice::ReadOnly)) return QByteArray();
+    while(!f.atEnd())
+    {
+        hash.addData(f.read(1024 * 1024));
+    }
+    return hash.result();
+}
+
+QByteArray SshMirror::_remoteHash(const QString &file)
+{
+    QString res = _client->runCommand("md5sum -- " + shellQuote(file));
+    if(res.length() < 32) return QByteArray();
+    return QByteArray::fromHex(res.left(32).toLatin1());
+}
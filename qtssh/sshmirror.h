@@ -0,0 +1,83 @@
+#ifndef SSHMIRROR_H
+#define SSHMIRROR_H
+
+#include <QObject>
+#include <QMap>
+#include <QByteArray>
+#include <QStringList>
+
+class SshClient;
+class SshSFtp;
+
+/*
+ * Mirror a local directory and a remote directory over SFTP.
+ *
+ * Both trees are scanned into manifests (size, mtime, optional md5), the local
+ * one on a worker thread while the remote one is listed. The minimal set of
+ * uploads, downloads and deletes is then executed, transfers being pipelined
+ * on the sftp session. The manifests are saved after each run : a remote
+ * directory whose mtime did not change is not listed again, its previous
+ * entries are reused and only its subdirectories are stat'ed and walked the
+ * same way, so adds and removes are seen at any depth.
+ *
+ * A directory mtime only moves when entries are added, removed or renamed.
+ * A remote file edited in place keeps the mtime of its directory, so the
+ * pruned scan does not see it : every fullScanEvery() runs (10 by default)
+ * the whole remote tree is listed again. setFullScan(true) lists it on
+ * every run, setFullScanEvery(0) never.
+ */
+class SshMirror : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Direction {
+        Upload,
+        Download,
+        Bidirectional
+    };
+
+    struct Entry {
+        quint64 size;
+        quint64 mtime;
+        bool isDir;
+        QByteArray hash;
+    };
+    typedef QMap<QString, Entry> Manifest;
+
+private:
+    SshClient *_client;
+    SshSFtp *_sftp;
+    QString _manifestFile;
+    bool _hashCompare;
+    bool _fullScan;
+    bool _pruneScan;
+    int _fullScanEvery;
+    quint32 _runs;
+    int _parallel;
+    Manifest _previousLocal;
+    Manifest _previousRemote;
+
+public:
+    explicit SshMirror(SshClient *client);
+
+    void setManifestFile(QString file);
+    void setHashCompare(bool enable);
+    void setFullScan(bool enable);
+    void setFullScanEvery(int runs);
+    void setParallelTransfers(int count);
+
+    bool mirror(QString localDir, QString remoteDir, Direction direction = Upload);
+
+signals:
+    void progress(int done, int total);
+
+private:
+    void _scanRemote(const QString &root, const QString &relative, Manifest &result);
+    void _scanRemoteDir(const QString &root, const QString &relative, quint64 mtime, Manifest &result);
+    bool _same(const QString &path, Entry &local, Entry &remote, const QString &localDir, const QString &remoteDir);
+    QByteArray _localHash(const QString &file);
+    QByteArray _remoteHash(const QString &file);
+};
+
+#endif // SSHMIRROR_H
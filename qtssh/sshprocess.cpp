@@ -2,11 +2,45 @@
 #include "sshclient.h"
 #include <QTimer>
 #include <QEventLoop>
+#include <QElapsedTimer>
+#include <string.h>
+
+#define PROCESS_READ_CHUNK (64 * 1024)
+#define PROCESS_READ_BUFFER (1024 * 1024)
+/* Sent bytes are removed from the write queue past this offset */
+#define PROCESS_WRITE_COMPACT (64 * 1024)
 
 SshProcess::SshProcess(SshClient *client) : SshChannel(client)
 {
     _isEOF = false;
     _isCommand = false;
+    _isShell = false;
+    _hasPty = false;
+    _ptyType = XtermTerminal;
+    _ptyCols = 80;
+    _ptyRows = 24;
+    _ptyResize = false;
+    _finished = false;
+    _discard = false;
+    _collect = false;
+    _pumpScheduled = false;
+    _readBufferSize = PROCESS_READ_BUFFER;
+    _readChannel = StandardOutput;
+    _dropped[StandardOutput] = 0;
+    _dropped[StandardError] = 0;
+    _exitCode = -1;
+    _writeOffset = 0;
+    _flushing = false;
+    _eofPending = false;
+    _writeFailed = false;
+    _timeout = 0;
+    _timedOut = false;
+    _canceled = false;
+    _deadline.setSingleShot(true);
+    QObject::connect(&_deadline, &QTimer::timeout, this, &SshProcess::_deadlineExpired);
+    _writeRetry.setSingleShot(true);
+    _writeRetry.setInterval(10);
+    QObject::connect(&_writeRetry, &QTimer::timeout, this, &SshProcess::_flush);
     _currentState = OpenChannelSession;
     sshDataReceived();
 }
@@ -18,109 +52,424 @@ SshProcess::~SshProcess()
 
 QString SshProcess::result()
 {
-    QByteArray buffer;
     QTimer singleshotTimer;
     QEventLoop loop;
+    bool idle = false;
     singleshotTimer.setInterval(2 * 60 * 1000);
     singleshotTimer.setSingleShot(true);
+    QObject::connect(&singleshotTimer, &QTimer::timeout, &loop, [&idle, &loop](){
+        idle = true;
+        loop.quit();
+    });
+    QObject::connect(this, &SshProcess::finished, &loop, &QEventLoop::quit);
     QObject::connect(this, &SshProcess::connected, &loop, &QEventLoop::quit);
-    QObject::connect(this, &SshProcess::readyRead, &loop, &QEventLoop::quit);
+    QObject::connect(this, &SshProcess::readyReadStandardOutput, &loop, &QEventLoop::quit);
+    QObject::connect(this, &SshProcess::readChannelFinished, &loop, &QEventLoop::quit);
+    QObject::connect(this, &SshProcess::channelOpenFailed, &loop, &QEventLoop::quit);
 
-    while(!_isEOF)
+    /* The whole output stays in the block chain, without read limit */
+    _collect = true;
+    _schedulePump();
+    while(!_isEOF && !_finished && _currentState != ErrorNoRetry)
     {
-        QByteArray result;
-        qint64 readBytes = 0;
-        qint64 readResult;
-
         singleshotTimer.start();
         loop.exec();
-
-        do {
-            result.resize(result.size() + 16*1024);
-            readResult = readData(result.data() + readBytes, result.size() - readBytes);
-            if (readResult > 0 || readBytes == 0)
-                readBytes += readResult;
-        } while (readResult > 0);
-
-        if (readBytes <= 0)
-            result.clear();
-        else
-            result.resize(int(readBytes));
-
-
-        if (!result.isEmpty())
+        if(idle)
         {
-            buffer.append(result);
+            /* Nothing received for 2 minutes : give up instead of hanging the caller */
+            qDebug() << "WARNING : SshProcess : no output from " << _cmd << ", canceled";
+            cancel();
+            break;
         }
     }
     singleshotTimer.stop();
+    _collect = false;
 
 #if defined(DEBUG_SSHCHANNEL)
     qDebug() << "DEBUG : SshProcess : Process return result";
 #endif
-    return QString(buffer);
+    return _stdout.readAllText();
+}
+
+SshBuffer &SshProcess::_buffer(ProcessChannel channel)
+{
+    return (channel == StandardOutput)?(_stdout):(_stderr);
+}
+
+void SshProcess::setReadChannel(ProcessChannel channel)
+{
+    _readChannel = channel;
+    _schedulePump();
+}
+
+SshProcess::ProcessChannel SshProcess::readChannel() const
+{
+    return _readChannel;
+}
+
+void SshProcess::setReadBufferSize(qint64 size)
+{
+    _readBufferSize = qMax<qint64>(PROCESS_READ_CHUNK, size);
+    _schedulePump();
+}
+
+qint64 SshProcess::readBufferSize() const
+{
+    return _readBufferSize;
+}
+
+QByteArray SshProcess::readAllStandardOutput()
+{
+    QByteArray out = _stdout.readAll();
+    if(!out.isEmpty()) _schedulePump();
+    return out;
+}
+
+QByteArray SshProcess::readAllStandardError()
+{
+    QByteArray err = _stderr.readAll();
+    if(!err.isEmpty()) _schedulePump();
+    return err;
+}
+
+qint64 SshProcess::droppedBytes(ProcessChannel channel) const
+{
+    return _dropped[channel];
+}
+
+void SshProcess::_trim(ProcessChannel channel)
+{
+    qint64 dropped = _buffer(channel).trim(_readBufferSize);
+    if(dropped == 0) return;
+    if(_dropped[channel] == 0)
+    {
+        qDebug() << "WARNING : SshProcess : " << _cmd << " unread " << ((channel == StandardOutput)?("stdout"):("stderr")) << " over " << _readBufferSize << " bytes, oldest data dropped";
+    }
+    _dropped[channel] += dropped;
+}
+
+qint64 SshProcess::bytesAvailable() const
+{
+    const SshBuffer &buffer = (_readChannel == StandardOutput)?(_stdout):(_stderr);
+    return buffer.size() + QIODevice::bytesAvailable();
+}
+
+bool SshProcess::atEnd() const
+{
+    return _isEOF && bytesAvailable() == 0;
 }
 
 qint64 SshProcess::readData(char *buff, qint64 len)
 {
-    ssize_t ret = 0;
-    ssize_t readbuf = 0;
+    qint64 count = _buffer(_readChannel).read(buff, len);
+
+    if(count > 0)
+    {
+        /* The pump may have stopped on a full buffer */
+        _schedulePump();
+    }
+    return count;
+}
+
+void SshProcess::_schedulePump()
+{
+    if(!_pumpScheduled && _currentState == ReadyRead && !_finished)
+    {
+        _pumpScheduled = true;
+        QTimer::singleShot(0, this, SLOT(_pump()));
+    }
+}
+
+void SshProcess::_pump()
+{
+    bool outData = false;
+    bool errData = false;
     bool eof = false;
+    bool done = false;
+    ssize_t ret = 0;
 
-    if (sshClient->session() == NULL)
+    _pumpScheduled = false;
+    if(_currentState != ReadyRead || sshChannel == NULL || _finished)
     {
-        qDebug() << "WARNING : QtSshChannel::readData Process when d_channel == NULL";
-        return -EAGAIN;
+        return;
     }
     if(!_channelInUse.tryAcquire())
     {
-        ret = -EAGAIN;
+        return;
     }
-    else
+
+    /* Stop pulling stdout when the consumer lags : the ssh window does the rest */
+    while(_discard || _collect || _readChannel != StandardOutput || _stdout.size() < _readBufferSize)
     {
-        do
+        int room;
+        char *tail = _stdout.reserve(room);
+        ret = libssh2_channel_read(sshChannel, tail, size_t(room));
+        if(ret <= 0) break;
+        _stdout.commit(int(ret));
+        emit data_rx(ret);
+        outData = true;
+        if(_discard) _stdout.clear();
+        else if(_readChannel != StandardOutput) _trim(StandardOutput);
+    }
+    while(ret >= 0 || ret == LIBSSH2_ERROR_EAGAIN)
+    {
+        if(!_discard && _readChannel == StandardError && _stderr.size() >= _readBufferSize) break;
+        int room;
+        char *tail = _stderr.reserve(room);
+        ssize_t err = libssh2_channel_read_stderr(sshChannel, tail, size_t(room));
+        if(err > 0) _stderr.commit(int(err));
+        if(err <= 0)
         {
-            ret = libssh2_channel_read(sshChannel, buff + readbuf, len - readbuf);
-            if(ret > 0) readbuf += ret;
-        } while((ret > 0) && (readbuf < len));
+            if(err != LIBSSH2_ERROR_EAGAIN) ret = err;
+            break;
+        }
+        emit data_rx(err);
+        errData = true;
+        if(_discard) _stderr.clear();
+        else if(_readChannel != StandardError) _trim(StandardError);
+    }
+
+    if(ret < 0 && ret != LIBSSH2_ERROR_EAGAIN)
+    {
+        qDebug() << "ERROR : SshProcess::_pump : err=" << ret;
+        char * errmsg;
+        int errlen;
+        int err = libssh2_session_last_error(sshClient->session(), &errmsg, &errlen, 0);
+        /* Channel closed or broken : no exit status will come, finish with -1 */
+        qDebug() << "ERROR : SshProcess : " << _cmd << " channel lost (" << err << ") " << QString::fromLocal8Bit(errmsg, errlen);
+        setErrorString("channel closed");
+        _currentState = ErrorNoRetry;
+        _finished = true;
+        _exitCode = -1;
+        done = true;
+        _deadline.stop();
+        QObject::disconnect(sshClient, SIGNAL(sshDataReceived()), this, SLOT(sshDataReceived()));
+    }
 
-        if (libssh2_channel_eof(sshChannel) == 1)
+    if(!_finished && !_isEOF && libssh2_channel_eof(sshChannel) == 1)
+    {
+        _isEOF = true;
+        eof = true;
+    }
+    if(!_finished && _isEOF && libssh2_channel_wait_closed(sshChannel) == 0)
+    {
+        /* The exit status and signal are sent before the channel close */
+        char *signame = NULL;
+        size_t signameLen = 0;
+        _exitCode = libssh2_channel_get_exit_status(sshChannel);
+        if(libssh2_channel_get_exit_signal(sshChannel, &signame, &signameLen, NULL, NULL, NULL, NULL) == 0 && signame)
         {
-            eof = true;
-            if (_isCommand)
-            {
-                _currentState = NoState;
-            }
+            _exitSignal = QString::fromLatin1(signame, int(signameLen));
+            libssh2_free(sshClient->session(), signame);
         }
+        _finished = true;
+        done = true;
+        _deadline.stop();
+        /* Nothing more to do on this channel : stop being woken by every packet */
+        QObject::disconnect(sshClient, SIGNAL(sshDataReceived()), this, SLOT(sshDataReceived()));
+    }
+    _channelInUse.release();
 
-        _channelInUse.release();
+    if(outData)
+    {
+        emit readyReadStandardOutput();
+        if(_readChannel == StandardOutput) emit readyRead();
+    }
+    if(errData)
+    {
+        emit readyReadStandardError();
+        if(_readChannel == StandardError) emit readyRead();
+    }
+    if(eof)
+    {
+        emit readChannelFinished();
+    }
+    if(done)
+    {
+#if defined(DEBUG_SSHCHANNEL)
+        qDebug() << "DEBUG : SshProcess : exit status " << _exitCode << " " << _exitSignal;
+#endif
+        emit finished(_exitCode);
+    }
+}
 
-        if (ret < 0)
+qint64 SshProcess::writeData(const char *buff, qint64 len)
+{
+    if(_currentState != ReadyRead || _finished || _eofPending || _writeFailed)
+    {
+        qDebug() << "WARNING : SshProcess::writeData on a terminated process";
+        return -1;
+    }
+    /* Queue the data, it is sent as the remote window opens */
+    _writeBuffer.append(buff, int(len));
+    _flush();
+    if(_hasPty)
+    {
+        /* Keystrokes : don't wait for the event loop to reach the socket */
+        sshClient->flushSocket();
+    }
+    return len;
+}
+
+qint64 SshProcess::bytesToWrite() const
+{
+    return _writeBuffer.size() - _writeOffset + QIODevice::bytesToWrite();
+}
+
+void SshProcess::_flush()
+{
+    qint64 written = 0;
+
+    if(_flushing || _currentState != ReadyRead || sshChannel == NULL)
+    {
+        return;
+    }
+    _flushing = true;
+    while(_writeOffset < _writeBuffer.size())
+    {
+        ssize_t ret = libssh2_channel_write(sshChannel, _writeBuffer.constData() + _writeOffset, size_t(_writeBuffer.size() - _writeOffset));
+        if(ret == LIBSSH2_ERROR_EAGAIN)
         {
-            // gestion erreurs
-            if (ret != LIBSSH2_ERROR_EAGAIN)
+            /* Resumed on the window adjust, or by the timer when the socket is full */
+            if(libssh2_session_block_directions(sshClient->session()) & LIBSSH2_SESSION_BLOCK_OUTBOUND)
             {
-                qDebug() << "ERROR : QtSshChannel::tryToRead Process : err=" << ret;
-                char * errmsg;
-                int errlen;
-
-                int err = libssh2_session_last_error(sshClient->session(), &errmsg, &errlen, 0);
-                if (err == LIBSSH2_ERROR_CHANNEL_CLOSED)
+                _writeRetry.start();
+            }
+            break;
+        }
+        if(ret < 0)
+        {
+            qDebug() << "ERROR : SshProcess::_flush : err=" << ret;
+            setErrorString("channel write error");
+            /* Nothing more can be sent : later writes fail instead of vanishing */
+            _writeFailed = true;
+            _eofPending = false;
+            _writeBuffer.clear();
+            _writeOffset = 0;
+            break;
+        }
+        _writeOffset += int(ret);
+        written += ret;
+    }
+    if(_writeOffset >= PROCESS_WRITE_COMPACT && _writeOffset < _writeBuffer.size())
+    {
+        /* A writer keeping the queue busy must not hold every byte already sent */
+        _writeBuffer.remove(0, _writeOffset);
+        _writeOffset = 0;
+    }
+    if(_writeOffset >= _writeBuffer.size())
+    {
+        _writeBuffer.clear();
+        _writeOffset = 0;
+        if(_eofPending)
+        {
+            int ret = libssh2_channel_send_eof(sshChannel);
+            if(ret == LIBSSH2_ERROR_EAGAIN)
+            {
+                if(libssh2_session_block_directions(sshClient->session()) & LIBSSH2_SESSION_BLOCK_OUTBOUND)
                 {
-                    _currentState = ErrorNoRetry;
+                    _writeRetry.start();
                 }
             }
+            else
+            {
+                _eofPending = false;
+            }
         }
+    }
+    _flushing = false;
 
+    if(written > 0)
+    {
+        emit data_tx(written);
+        emit bytesWritten(written);
+    }
+}
 
-        _isEOF = eof;
+bool SshProcess::waitForBytesWritten(int msecs)
+{
+    QElapsedTimer elapsed;
+    qint64 pending = bytesToWrite();
 
-        if (readbuf > 0) emit data_rx(readbuf);
-        ret = readbuf;
+    elapsed.start();
+    while(pending > 0 && bytesToWrite() >= pending && _currentState == ReadyRead && !_finished && !_writeFailed && !elapsed.hasExpired(msecs))
+    {
+        _waitData(qMin<qint64>(1000, msecs - elapsed.elapsed()));
+        _flush();
     }
-    return ret;
+    return pending > 0 && bytesToWrite() < pending;
+}
+
+void SshProcess::closeWriteChannel()
+{
+    if(sshChannel == NULL) return;
+    /* EOF goes out once the queued data is sent */
+    _eofPending = true;
+    _flush();
+}
+
+bool SshProcess::waitForStarted(int msecs)
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while(_currentState != ReadyRead && _currentState != ErrorNoRetry && !elapsed.hasExpired(msecs))
+    {
+        _waitData(qMin<qint64>(1000, msecs - elapsed.elapsed()));
+    }
+    return _currentState == ReadyRead;
+}
+
+bool SshProcess::isEOF() const
+{
+    return _isEOF;
 }
 
+bool SshProcess::isFinished() const
+{
+    return _finished;
+}
+
+QString SshProcess::exitSignal() const
+{
+    return _exitSignal;
+}
+
+bool SshProcess::hasExitStatus() const
+{
+    /* Canceled, refused or lost channels end in ErrorNoRetry with exit code -1 */
+    return _finished && _currentState != ErrorNoRetry;
+}
+
+int SshProcess::exitStatus()
+{
+    if(sshChannel == NULL) return -1;
+    /* Drop the remaining output, the exit status comes after it */
+    _discard = true;
+    _stdout.clear();
+    _stderr.clear();
+    while(!_finished && _currentState != ErrorNoRetry)
+    {
+        _flush();
+        _pump();
+        if(!_finished) _waitData(1000);
+    }
+    return _exitCode;
+}
+
+bool SshProcess::_waitData(int timeout)
+{
+    bool ret;
+    QEventLoop wait;
+    QTimer timer;
+    QObject::connect(sshClient, &SshClient::sshDataReceived, &wait, &QEventLoop::quit);
+    QObject::connect(&timer, &QTimer::timeout, &wait, &QEventLoop::quit);
+    timer.setSingleShot(true);
+    timer.start(timeout);
+    wait.exec();
+    ret = timer.isActive();
+    timer.stop();
+    return ret;
+}
 
 void SshProcess::sshDataReceived()
 {
@@ -128,13 +477,42 @@ void SshProcess::sshDataReceived()
     {
         case OpenChannelSession:
         {
-            sshChannel=libssh2_channel_open_session(sshClient->session());
+            /* A pre-opened channel saves the open round trip */
+            sshChannel = sshClient->takeChannel();
+            if (sshChannel == NULL)
+            {
+                LIBSSH2_SESSION *session = sshClient->session();
+                if (!sshClient->lockChannelOpen(this, [session]() {
+                        LIBSSH2_CHANNEL *channel = libssh2_channel_open_session(session);
+                        if (channel)
+                        {
+                            libssh2_channel_close(channel);
+                            libssh2_channel_free(channel);
+                        }
+                        return channel != NULL || libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN;
+                    }))
+                {
+                    /* Another open is in flight on the session */
+                    return;
+                }
+                sshChannel = libssh2_channel_open_session(session);
+                if (sshChannel != NULL || libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN)
+                {
+                    sshClient->unlockChannelOpen(this);
+                }
+            }
             if (sshChannel == NULL)
             {
                 if (libssh2_session_last_error(sshClient->session(), NULL, NULL, 0) == LIBSSH2_ERROR_EAGAIN)
                 {
                     return;
                 }
+                /* Usually the server MaxSessions limit : report it once the caller is connected */
+                qDebug() << "ERROR : SshProcess : channel session refused";
+                setErrorString("channel open failed");
+                _currentState = ErrorNoRetry;
+                QMetaObject::invokeMethod(this, "channelOpenFailed", Qt::QueuedConnection);
+                return;
             }
             else
             {
@@ -164,7 +542,9 @@ void SshProcess::sshDataReceived()
         {
             if(sshChannel != NULL)
             {
-                int ret = libssh2_channel_request_pty(sshChannel, "");
+                static const char *terms[] = {"vanilla", "vt102", "ansi", "xterm"};
+                const char *term = terms[_ptyType];
+                int ret = libssh2_channel_request_pty_ex(sshChannel, term, unsigned(strlen(term)), NULL, 0, _ptyCols, _ptyRows, 0, 0);
                 if (ret)
                 {
                     if (ret == LIBSSH2_ERROR_EAGAIN)
@@ -174,6 +554,8 @@ void SshProcess::sshDataReceived()
                     else
                     {
                         qDebug() << "ERROR : QtSshChannel : pty allocation failed";
+                        /* The channel was granted : not a MaxSessions refusal */
+                        _fail("pty allocation failed");
                         return;
                     }
                 }
@@ -196,7 +578,7 @@ void SshProcess::sshDataReceived()
         {
             if(sshChannel != NULL)
             {
-                int ret = libssh2_channel_exec(sshChannel, qPrintable(_cmd));
+                int ret = (_isShell)?(libssh2_channel_shell(sshChannel)):(libssh2_channel_exec(sshChannel, qPrintable(_cmd)));
                 if (ret)
                 {
                     if (ret == LIBSSH2_ERROR_EAGAIN)
@@ -206,6 +588,8 @@ void SshProcess::sshDataReceived()
                     else
                     {
                         qDebug() << "ERROR : QtSshChannel : process exec failed";
+                        /* The channel was opened : this is not a MaxSessions refusal */
+                        _fail("process exec failed");
                         return;
                     }
                 }
@@ -214,11 +598,11 @@ void SshProcess::sshDataReceived()
 #if defined(DEBUG_SSHCHANNEL)
                     qDebug() << "DEBUG : QtSshChannel : process exec opened";
 #endif
-                    //setOpenMode(QIODevice::ReadWrite);
+                    setOpenMode(QIODevice::ReadWrite | QIODevice::Unbuffered);
                     _isCommand = true;
-                    //d_state = 66;
                     _currentState = ReadyRead;
                     emit connected();
+                    _pump();
                     return;
                 }
             }
@@ -230,7 +614,9 @@ void SshProcess::sshDataReceived()
         }
         case ReadyRead:
         {
-            emit readyRead();
+            if(_ptyResize) _resizePty();
+            _flush();
+            _pump();
             return;
         }
         case ErrorNoRetry:
@@ -241,6 +627,147 @@ void SshProcess::sshDataReceived()
     }
 }
 
+void SshProcess::setTimeout(int msecs)
+{
+    _timeout = msecs;
+    if(_deadline.isActive())
+    {
+        if(_timeout > 0) _deadline.start(_timeout);
+        else _deadline.stop();
+    }
+}
+
+int SshProcess::timeout() const
+{
+    return _timeout;
+}
+
+bool SshProcess::isTimedOut() const
+{
+    return _timedOut;
+}
+
+bool SshProcess::isCanceled() const
+{
+    return _canceled;
+}
+
+void SshProcess::_deadlineExpired()
+{
+    if(_finished) return;
+    qDebug() << "WARNING : SshProcess : " << _cmd << " timed out after " << _timeout << "ms";
+    _timedOut = true;
+    emit timedOut();
+    cancel();
+}
+
+void SshProcess::cancel(QString signal)
+{
+    if(_finished) return;
+
+    _deadline.stop();
+    _canceled = true;
+    _finished = true;
+    _exitCode = -1;
+    _currentState = ErrorNoRetry;
+    QObject::disconnect(sshClient, SIGNAL(sshDataReceived()), this, SLOT(sshDataReceived()));
+    if(sshChannel != NULL)
+    {
+#if LIBSSH2_VERSION_NUM >= 0x010b00
+        /* Best effort : most servers ignore signal requests */
+        QByteArray name = signal.toLatin1();
+        libssh2_channel_signal_ex(sshChannel, name.constData(), size_t(name.size()));
+#else
+        Q_UNUSED(signal);
+#endif
+        _closeChannel();
+    }
+    else
+    {
+        /* Leave the open queue, or let the client finish and free our half-done open */
+        sshClient->abandonChannelOpen(this);
+    }
+    setErrorString((_timedOut)?("timeout"):("canceled"));
+    emit finished(_exitCode);
+}
+
+void SshProcess::_fail(QString error)
+{
+    setErrorString(error);
+    _currentState = ErrorNoRetry;
+    _finished = true;
+    _exitCode = -1;
+    _deadline.stop();
+    QObject::disconnect(sshClient, SIGNAL(sshDataReceived()), this, SLOT(sshDataReceived()));
+    /* Emitted once the caller had a chance to connect */
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection, Q_ARG(int, -1));
+}
+
+void SshProcess::_closeChannel()
+{
+    if(sshChannel != NULL && libssh2_channel_close(sshChannel) == LIBSSH2_ERROR_EAGAIN)
+    {
+        QTimer::singleShot(10, this, SLOT(_closeChannel()));
+    }
+}
+
+void SshProcess::requestPty(SshProcess::TerminalType type, int cols, int rows)
+{
+    /* Too late once the command was sent, even if its exec is still pending */
+    if (_currentState == StartCmdProcess || _currentState > RequestPty || _hasPty)
+    {
+        qDebug() << "WARNING : SshProcess : requestPty() after the command was sent ignored";
+        return;
+    }
+    _hasPty = true;
+    _ptyType = type;
+    _ptyCols = cols;
+    _ptyRows = rows;
+    sshClient->holdLowDelay(this);
+    QObject::connect(this, &SshProcess::finished, this, [this](){
+        sshClient->releaseLowDelay(this);
+    });
+    QObject::connect(this, &SshProcess::channelOpenFailed, this, [this](){
+        sshClient->releaseLowDelay(this);
+    });
+    if (_currentState == EarlyCmdTransition)
+    {
+        _currentState = RequestPty;
+        sshDataReceived();
+    }
+    else
+    {
+        /* Before the command, even if start() was already called */
+        _nextActions.prepend(RequestPty);
+    }
+}
+
+void SshProcess::resizePty(int cols, int rows)
+{
+    _ptyCols = cols;
+    _ptyRows = rows;
+    if (_currentState == ReadyRead && _hasPty)
+    {
+        _ptyResize = true;
+        _resizePty();
+    }
+}
+
+void SshProcess::_resizePty()
+{
+    if (sshChannel == NULL || _finished) return;
+    int ret = libssh2_channel_request_pty_size(sshChannel, _ptyCols, _ptyRows);
+    /* On EAGAIN, retried on the next packet */
+    _ptyResize = (ret == LIBSSH2_ERROR_EAGAIN);
+    if (ret == 0) sshClient->flushSocket();
+}
+
+void SshProcess::startShell()
+{
+    _isShell = true;
+    start("shell");
+}
+
 void SshProcess::start(QString cmd)
 {
     if (_currentState > RequestPty)
@@ -248,6 +775,10 @@ void SshProcess::start(QString cmd)
         return;
     }
     _cmd = cmd;
+    if(_timeout > 0)
+    {
+        _deadline.start(_timeout);
+    }
     if (_currentState == EarlyCmdTransition)
     {
         _currentState = StartCmdProcess;
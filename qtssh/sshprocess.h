@@ -1,18 +1,62 @@
 #ifndef SSHPROCESS_H
 #define SSHPROCESS_H
 #include "sshchannel.h"
+#include "sshbuffer.h"
 #include <QSemaphore>
+#include <QTimer>
 
+/*
+ * Remote command on an exec channel, readable as a sequential QIODevice.
+ *
+ * Standard output and standard error are pumped into separate buffers as
+ * data arrives. The pump stops reading the channel when the buffer of the
+ * current read channel holds readBufferSize() bytes, so a slow consumer
+ * throttles the remote command through the ssh window. The other stream is
+ * kept bounded by dropping its oldest bytes beyond readBufferSize() : not
+ * reading it would stall a command whose caller never looks at it. Losses
+ * are logged once and counted by droppedBytes(). Read both streams, or
+ * switch readChannel(), to get all of them. Both buffers are block chains
+ * (SshBuffer) : incoming data is never moved, and result() decodes the
+ * whole output once at the end.
+ *
+ * Writes are queued and sent as the remote window opens, bytesWritten() is
+ * emitted as they go out. Writers should wait on bytesToWrite() to keep the
+ * queue short. closeWriteChannel() sends EOF once the queue is empty. After
+ * a channel write error the queue is dropped and write() returns -1, the
+ * output can still be read.
+ *
+ * For interactive use, requestPty() before start() or startShell() allocates
+ * a terminal, resizePty() follows the window size. Writes on a pty channel
+ * are pushed to the socket at once, with TCP_NODELAY set on the session
+ * until the last pty process finishes. requestPty() once the command was
+ * sent is ignored. A refused pty ends with finished(-1) and errorString().
+ *
+ * channelOpenFailed() means the server refused the channel itself (usually
+ * its MaxSessions limit). A refused exec or a channel lost while running
+ * ends with finished(-1) and errorString().
+ *
+ * With setTimeout(), a command still running at the deadline is canceled :
+ * it is sent a signal (libssh2 1.11 and later) then its channel is closed,
+ * and finished(-1) is emitted without blocking the caller.
+ */
 class SshProcess : public SshChannel
 {
     Q_OBJECT
 
+public:
+    enum ProcessChannel {
+        StandardOutput,
+        StandardError
+    };
+
     enum TerminalType{
         VanillaTerminal,
         Vt102Terminal,
-        AnsiTerminal
+        AnsiTerminal,
+        XtermTerminal
     };
 
+private:
     enum SshProcessState {
         NoState,
         OpenChannelSession,
@@ -26,26 +70,100 @@ class SshProcess : public SshChannel
     SshProcessState _currentState;
     QSemaphore _channelInUse;
     bool _isCommand;
+    bool _isShell;
+    bool _hasPty;
+    TerminalType _ptyType;
+    int _ptyCols;
+    int _ptyRows;
+    bool _ptyResize;
     bool _isEOF;
+    bool _finished;
+    bool _discard;
+    bool _pumpScheduled;
     QString _cmd;
     QList<SshProcessState> _nextActions;
+    SshBuffer _stdout;
+    SshBuffer _stderr;
+    qint64 _dropped[2];
+    bool _collect;
+    qint64 _readBufferSize;
+    ProcessChannel _readChannel;
+    int _exitCode;
+    QString _exitSignal;
+    int _timeout;
+    bool _timedOut;
+    bool _canceled;
+    QTimer _deadline;
+    QByteArray _writeBuffer;
+    int _writeOffset;
+    bool _flushing;
+    bool _eofPending;
+    bool _writeFailed;
+    QTimer _writeRetry;
 
 public:
     explicit SshProcess(SshClient *client);
     virtual ~SshProcess();
     QString result();
-    qint64 readData(char * buff, qint64 len);
+    bool waitForStarted(int msecs = 30000);
+    void closeWriteChannel();
+    bool isEOF() const;
+    bool isFinished() const;
+    void setTimeout(int msecs);
+    int timeout() const;
+    bool isTimedOut() const;
+    bool isCanceled() const;
+    int exitStatus();
+    QString exitSignal() const;
+    bool hasExitStatus() const;
+
+    void setReadChannel(ProcessChannel channel);
+    ProcessChannel readChannel() const;
+    void setReadBufferSize(qint64 size);
+    qint64 readBufferSize() const;
+    QByteArray readAllStandardOutput();
+    QByteArray readAllStandardError();
+    qint64 droppedBytes(ProcessChannel channel) const;
+    qint64 bytesAvailable() const;
+    qint64 bytesToWrite() const;
+    bool waitForBytesWritten(int msecs);
+    bool atEnd() const;
 
 signals:
-    void readyRead();
     void connected();
-    
+    void readyReadStandardOutput();
+    void readyReadStandardError();
+    void finished(int exitCode);
+    void channelOpenFailed();
+    void timedOut();
+
 public slots:
     void start(QString cmd);
+    void startShell();
+    void requestPty(SshProcess::TerminalType type = XtermTerminal, int cols = 80, int rows = 24);
+    void resizePty(int cols, int rows);
+    void cancel(QString signal = "TERM");
+
+protected:
+    qint64 readData(char * buff, qint64 len);
+    qint64 writeData(const char * buff, qint64 len);
 
 protected slots:
     virtual void sshDataReceived();
-    
+
+private slots:
+    void _pump();
+    void _flush();
+    void _deadlineExpired();
+    void _closeChannel();
+    void _resizePty();
+
+private:
+    bool _waitData(int timeout);
+    void _schedulePump();
+    SshBuffer &_buffer(ProcessChannel channel);
+    void _trim(ProcessChannel channel);
+    void _fail(QString error);
 };
 
 #endif // SSHPROCESS_H
@@ -0,0 +1,255 @@
+#include "sshremotewatcher.h"
+#include "sshclient.h"
+#include "sshprocess.h"
+#include "sshsftp.h"
+#include "sshutils.h"
+#include <QDebug>
+
+SshRemoteWatcher::SshRemoteWatcher(SshClient *client, QString root, WatchMode mode):
+    QObject(client),
+    _client(client),
+    _sftp(client->sftp()),
+    _root(root),
+    _mode(mode),
+    _inotify(NULL),
+    _primed(false),
+    _fullRescanEvery(10),
+    _pollCount(0)
+{
+    while(_root.length() > 1 && _root.endsWith("/"))
+    {
+        _root.chop(1);
+    }
+    _timer.setInterval(5000);
+    QObject::connect(&_timer, &QTimer::timeout, this, &SshRemoteWatcher::_poll);
+}
+
+SshRemoteWatcher::~SshRemoteWatcher()
+{
+    stop();
+}
+
+QString SshRemoteWatcher::root() const
+{
+    return _root;
+}
+
+SshRemoteWatcher::WatchMode SshRemoteWatcher::mode() const
+{
+    return _mode;
+}
+
+QMap<QString, SshRemoteWatcher::Entry> SshRemoteWatcher::snapshot() const
+{
+    return _snapshot;
+}
+
+void SshRemoteWatcher::setPollInterval(int msecs)
+{
+    _timer.setInterval(msecs);
+}
+
+void SshRemoteWatcher::setFullRescanEvery(int polls)
+{
+    _fullRescanEvery = polls;
+}
+
+int SshRemoteWatcher::fullRescanEvery() const
+{
+    return _fullRescanEvery;
+}
+
+void SshRemoteWatcher::start()
+{
+    if(_mode != PollingMode)
+    {
+        if(_startInotify())
+        {
+            _mode = InotifyMode;
+            return;
+        }
+        qDebug() << "WARNING : SshRemoteWatcher : inotifywait not available, polling " << _root;
+        _mode = PollingMode;
+    }
+    rescan(true);
+    _timer.start();
+}
+
+void SshRemoteWatcher::stop()
+{
+    _timer.stop();
+    if(_inotify)
+    {
+        delete _inotify;
+        _inotify = NULL;
+    }
+}
+
+bool SshRemoteWatcher::_startInotify()
+{
+    if(_client->runCommand("command -v inotifywait").trimmed().isEmpty())
+    {
+        return false;
+    }
+
+    _inotify = new SshProcess(_client);
+    QObject::connect(_inotify, &SshProcess::readyRead, this, &SshRemoteWatcher::_inotifyData);
+    QObject::connect(_inotify, &SshProcess::finished, this, &SshRemoteWatcher::_inotifyFinished);
+    _inotify->start(QString("inotifywait -m -r -q -e close_write -e attrib -e create -e delete -e moved_to -e moved_from --format '%e|%w%f' %1").arg(shellQuote(_root)));
+#if defined(DEBUG_SSHCHANNEL)
+    qDebug() << "DEBUG : SshRemoteWatcher : inotifywait started on " << _root;
+#endif
+    return true;
+}
+
+void SshRemoteWatcher::_inotifyData()
+{
+    QByteArray chunk(16384, 0);
+    qint64 len;
+    int nl;
+
+    while((len = _inotify->read(chunk.data(), chunk.size())) > 0)
+    {
+        _pending.append(chunk.constData(), int(len));
+    }
+
+    while((nl = _pending.indexOf('\n')) >= 0)
+    {
+        QByteArray line = _pending.left(nl);
+        _pending.remove(0, nl + 1);
+
+        int sep = line.indexOf('|');
+        if(sep < 0) continue;
+
+        QList<QByteArray> events = line.left(sep).split(',');
+        QString path = QString::fromUtf8(line.mid(sep + 1));
+
+        if(events.contains("CREATE") || events.contains("MOVED_TO"))
+        {
+            _emitChange(path, Added);
+        }
+        else if(events.contains("DELETE") || events.contains("MOVED_FROM"))
+        {
+            _emitChange(path, Removed);
+        }
+        else if(events.contains("CLOSE_WRITE") || events.contains("ATTRIB"))
+        {
+            _emitChange(path, Modified);
+        }
+    }
+}
+
+void SshRemoteWatcher::_inotifyFinished(int exitCode)
+{
+    /* inotifywait died (watch limit, root removed...) : keep watching by polling */
+    qDebug() << "WARNING : SshRemoteWatcher : inotifywait exited with " << exitCode << ", polling " << _root;
+    _inotify->deleteLater();
+    _inotify = NULL;
+    _mode = PollingMode;
+    rescan(true);
+    _timer.start();
+}
+
+void SshRemoteWatcher::_poll()
+{
+    ++_pollCount;
+    rescan(_fullRescanEvery > 0 && (_pollCount % _fullRescanEvery) == 0);
+}
+
+void SshRemoteWatcher::rescan(bool full)
+{
+    QMap<QString, Entry> current;
+    _scan(_root, full || !_primed, current);
+
+    if(_primed)
+    {
+        /* Both snapshots are sorted by path : walk them side by side */
+        QMap<QString, Entry>::const_iterator o = _snapshot.constBegin();
+        QMap<QString, Entry>::const_iterator n = current.constBegin();
+        while(o != _snapshot.constEnd() || n != current.constEnd())
+        {
+            if(n == current.constEnd() || (o != _snapshot.constEnd() && o.key() < n.key()))
+            {
+                _emitChange(o.key(), Removed);
+                ++o;
+            }
+            else if(o == _snapshot.constEnd() || n.key() < o.key())
+            {
+                _emitChange(n.key(), Added);
+                ++n;
+            }
+            else
+            {
+                if(!n->isDir && (n->size != o->size || n->mtime != o->mtime))
+                {
+                    _emitChange(n.key(), Modified);
+                }
+                ++o;
+                ++n;
+            }
+        }
+    }
+    _snapshot = current;
+    _primed = true;
+}
+
+void SshRemoteWatcher::_scan(const QString &dir, bool full, QMap<QString, Entry> &result)
+{
+    QMap<QString, LIBSSH2_SFTP_ATTRIBUTES> list = _sftp->readdirAttributes(dir);
+    QString prefix = (dir.endsWith("/"))?(dir):(dir + "/");
+
+    for(QMap<QString, LIBSSH2_SFTP_ATTRIBUTES>::const_iterator it = list.constBegin(); it != list.constEnd(); ++it)
+    {
+        QString path = prefix + it.key();
+        Entry entry;
+        entry.size  = it->filesize;
+        entry.mtime = it->mtime;
+        entry.isDir = LIBSSH2_SFTP_S_ISDIR(it->permissions);
+        result.insert(path, entry);
+
+        if(entry.isDir) _scanDir(path, entry.mtime, full, result);
+    }
+}
+
+void SshRemoteWatcher::_scanDir(const QString &dir, quint64 mtime, bool full, QMap<QString, Entry> &result)
+{
+    QMap<QString, Entry>::const_iterator old = _snapshot.constFind(dir);
+    if(full || old == _snapshot.constEnd() || !old->isDir || old->mtime != mtime)
+    {
+        _scan(dir, full, result);
+        return;
+    }
+
+    /*
+     * No entry added or removed right here : reuse the previous direct
+     * entries, but subdirectories may have changed on their own, so each
+     * of them is stat'ed and walked the same way.
+     */
+    QString sub = dir + "/";
+    for(QMap<QString, Entry>::const_iterator o = _snapshot.lowerBound(sub); o != _snapshot.constEnd() && o.key().startsWith(sub); ++o)
+    {
+        if(o.key().indexOf('/', sub.length()) >= 0) continue;
+        Entry entry = o.value();
+        if(entry.isDir)
+        {
+            LIBSSH2_SFTP_ATTRIBUTES attrs;
+            if(!_sftp->stat(o.key(), attrs)) continue;
+            entry.mtime = attrs.mtime;
+            result.insert(o.key(), entry);
+            _scanDir(o.key(), entry.mtime, full, result);
+        }
+        else
+        {
+            result.insert(o.key(), entry);
+        }
+    }
+}
+
+void SshRemoteWatcher::_emitChange(const QString &path, ChangeType type)
+{
+#if defined(DEBUG_SFTP)
+    qDebug() << "DEBUG : SshRemoteWatcher : " << path << " changed " << type;
+#endif
+    _sftp->invalidateFileInfo(path);
+    emit changed(path, type);
+}
@@ -0,0 +1,95 @@
+#ifndef SSHREMOTEWATCHER_H
+#define SSHREMOTEWATCHER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QMap>
+#include <QByteArray>
+
+class SshClient;
+class SshSFtp;
+class SshProcess;
+
+/*
+ * Watch a remote directory tree and report added, modified and removed paths.
+ *
+ * When inotifywait is installed on the remote host, its output is streamed
+ * through an exec channel. Otherwise the tree is listed periodically over SFTP
+ * and diffed against an in-memory snapshot. A directory whose mtime is
+ * unchanged is not listed again, except every fullRescanEvery() polls : its
+ * previous entries are reused and only its subdirectories are stat'ed, then
+ * walked the same way, so adds and removes are seen at any depth. A
+ * directory mtime only moves when entries are added, removed or renamed :
+ * a file rewritten in place is reported up to fullRescanEvery() poll
+ * intervals late (10 by default). Use setFullRescanEvery(1) to list the
+ * whole tree on every poll.
+ */
+class SshRemoteWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum ChangeType {
+        Added,
+        Modified,
+        Removed
+    };
+    Q_ENUM(ChangeType)
+
+    enum WatchMode {
+        AutoMode,
+        InotifyMode,
+        PollingMode
+    };
+
+    struct Entry {
+        quint64 size;
+        quint64 mtime;
+        bool isDir;
+    };
+
+private:
+    SshClient *_client;
+    SshSFtp *_sftp;
+    QString _root;
+    WatchMode _mode;
+    SshProcess *_inotify;
+    QByteArray _pending;
+    QMap<QString, Entry> _snapshot;
+    bool _primed;
+    QTimer _timer;
+    int _fullRescanEvery;
+    int _pollCount;
+
+public:
+    explicit SshRemoteWatcher(SshClient *client, QString root, WatchMode mode = AutoMode);
+    virtual ~SshRemoteWatcher();
+
+    QString root() const;
+    WatchMode mode() const;
+    QMap<QString, Entry> snapshot() const;
+    void setPollInterval(int msecs);
+    void setFullRescanEvery(int polls);
+    int fullRescanEvery() const;
+
+public slots:
+    void start();
+    void stop();
+    void rescan(bool full = true);
+
+signals:
+    void changed(QString path, SshRemoteWatcher::ChangeType type);
+
+private slots:
+    void _poll();
+    void _inotifyData();
+    void _inotifyFinished(int exitCode);
+
+private:
+    bool _startInotify();
+    void _scan(const QString &dir, bool full, QMap<QString, Entry> &result);
+    void _scanDir(const QString &dir, quint64 mtime, bool full, QMap<QString, Entry> &result);
+    void _emitChange(const QString &path, ChangeType type);
+};
+
+#endif // SSHREMOTEWATCHER_H
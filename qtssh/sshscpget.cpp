@@ -0,0 +1,208 @@
+#include "sshscpget.h"
+#include "sshclient.h"
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <qdebug.h>
+#include <string.h>
+#include <fcntl.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#define SCP_BUFFER_LEN (512 * 1024)
+
+SshScpGet::SshScpGet(SshClient *client, QString source, QString dest):
+    SshChannel(client),
+    _source(source),
+    _destination(dest),
+    _device(NULL),
+    _file(NULL),
+    _currentState(ScpGetPrepare),
+    _received(0),
+    _buffer(SCP_BUFFER_LEN, 0),
+    _state(false)
+{
+    memset(&_fileinfo, 0, sizeof(_fileinfo));
+    _retry.setSingleShot(true);
+    _retry.setInterval(10);
+    QObject::connect(&_retry, &QTimer::timeout, this, &SshScpGet::sshDataReceived);
+}
+
+SshScpGet::SshScpGet(SshClient *client, QString source, QIODevice *device):
+    SshChannel(client),
+    _source(source),
+    _device(device),
+    _file(NULL),
+    _currentState(ScpGetPrepare),
+    _received(0),
+    _buffer(SCP_BUFFER_LEN, 0),
+    _state(false)
+{
+    memset(&_fileinfo, 0, sizeof(_fileinfo));
+    _retry.setSingleShot(true);
+    _retry.setInterval(10);
+    QObject::connect(&_retry, &QTimer::timeout, this, &SshScpGet::sshDataReceived);
+}
+
+SshScpGet::~SshScpGet()
+{
+    delete _file;
+}
+
+bool SshScpGet::state() const
+{
+    return _state;
+}
+
+QString SshScpGet::destination() const
+{
+    return _destination;
+}
+
+bool SshScpGet::get()
+{
+    if(!_device)
+    {
+        if(QFileInfo(_destination).isDir())
+        {
+            _destination = QDir(_destination).absoluteFilePath(QFileInfo(_source).fileName());
+        }
+        _file = new QFile(_destination);
+        if(!_file->open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qDebug() << "ERROR : Can't open local file " << _destination;
+            _currentState = ScpGetEnd;
+            return false;
+        }
+        _device = _file;
+    }
+    _currentState = ScpGetPrepare;
+    /* Start without waiting for incoming ssh data */
+    QTimer::singleShot(0, this, SLOT(sshDataReceived()));
+    return true;
+}
+
+void SshScpGet::_finish(bool ok)
+{
+    _state = ok;
+    _currentState = ScpGetEnd;
+    stopChannel();
+    if(_file)
+    {
+        _file->close();
+        if(ok)
+        {
+            QByteArray native = QFile::encodeName(_destination);
+            struct utimbuf times;
+            ::chmod(native.constData(), _fileinfo.st_mode & 0777);
+            times.actime  = _fileinfo.st_atime;
+            times.modtime = _fileinfo.st_mtime;
+            ::utime(native.constData(), &times);
+        }
+        else
+        {
+            _file->remove();
+        }
+    }
+    emit transfertTerminate();
+}
+
+void SshScpGet::sshDataReceived()
+{
+    switch(_currentState)
+    {
+    case ScpGetPrepare:
+        if(!sshChannel) {
+            LIBSSH2_SESSION *session = sshClient->session();
+            QByteArray source = _source.toLocal8Bit();
+            if(!sshClient->lockChannelOpen(this, [session, source]() {
+                    libssh2_struct_stat fileinfo;
+                    LIBSSH2_CHANNEL *channel = libssh2_scp_recv2(session, source.constData(), &fileinfo);
+                    if(channel)
+                    {
+                        libssh2_channel_close(channel);
+                        libssh2_channel_free(channel);
+                    }
+                    return channel != NULL || libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN;
+                }))
+            {
+                break;
+            }
+            sshChannel = libssh2_scp_recv2(session, source.constData(), &_fileinfo);
+            if(sshChannel || libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN) {
+                sshClient->unlockChannelOpen(this);
+            }
+
+            if ((!sshChannel) && (libssh2_session_last_errno(sshClient->session()) != LIBSSH2_ERROR_EAGAIN)) {
+                char *errmsg;
+                int errlen;
+                libssh2_session_last_error(sshClient->session(), &errmsg, &errlen, 0);
+                qDebug() << "ERROR : Unable to open a session: " << errmsg;
+                _currentState = ScpGetError;
+                sshDataReceived();
+                break;
+            }
+        }
+        if(sshChannel) {
+#ifdef DEBUG_SCPGET
+            qDebug() << "DEBUG : ScpGetPrepare Receive Accepted, size " << _fileinfo.st_size;
+#endif
+            if(_file && _fileinfo.st_size > 0)
+            {
+                /* Reserve the blocks upfront, the data is written sequentially */
+                posix_fallocate(_file->handle(), 0, _fileinfo.st_size);
+            }
+            _currentState = ScpGetCopy;
+            emit channelOpened();
+            sshDataReceived();
+        }
+        break;
+
+    case ScpGetCopy:
+        while(_received < qint64(_fileinfo.st_size))
+        {
+            /* scp sends a trailing status byte after the data : never read past the size */
+            size_t len = size_t(qMin<qint64>(_buffer.size(), qint64(_fileinfo.st_size) - _received));
+            ssize_t rc = libssh2_channel_read(sshChannel, _buffer.data(), len);
+            if(rc == LIBSSH2_ERROR_EAGAIN)
+            {
+                if(libssh2_session_block_directions(sshClient->session()) & LIBSSH2_SESSION_BLOCK_OUTBOUND)
+                {
+                    /* Window adjust pending on the socket */
+                    _retry.start();
+                }
+                return;
+            }
+            if(rc <= 0)
+            {
+                qDebug() << "ERROR : Receive error " << rc;
+                _currentState = ScpGetError;
+                sshDataReceived();
+                return;
+            }
+            if(_device->write(_buffer.constData(), rc) != rc)
+            {
+                qDebug() << "ERROR : Write error on " << _destination;
+                _currentState = ScpGetError;
+                sshDataReceived();
+                return;
+            }
+            _received += rc;
+            emit data_rx(rc);
+            emit progress(_received, qint64(_fileinfo.st_size));
+        }
+        _finish(true);
+        break;
+
+    case ScpGetError:
+        qDebug() << "ERROR : SCP ERROR";
+        _finish(false);
+        break;
+
+    case ScpGetEnd:
+#ifdef DEBUG_SCPGET
+        qDebug() << "DEBUG : Wait end";
+#endif
+        break;
+    }
+}
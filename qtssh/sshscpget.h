@@ -0,0 +1,58 @@
+#ifndef SSHSCPGET_H
+#define SSHSCPGET_H
+
+
+#include "sshchannel.h"
+#include <QTimer>
+
+class QIODevice;
+class QFile;
+
+enum SshScpGetState {
+    ScpGetError = 0,
+    ScpGetPrepare = 1,
+    ScpGetCopy = 2,
+    ScpGetEnd = 3
+};
+
+/*
+ * Fetch one file with scp, for hosts without a sftp subsystem. The data is
+ * streamed into a local file (mode and mtime preserved) or into any open
+ * QIODevice as it arrives.
+ */
+class SshScpGet : public SshChannel
+{
+    Q_OBJECT
+
+    QString _source;
+    QString _destination;
+    QIODevice *_device;
+    QFile *_file;
+    SshScpGetState _currentState;
+    libssh2_struct_stat _fileinfo;
+    qint64 _received;
+    QByteArray _buffer;
+    bool _state;
+    QTimer _retry;
+
+    void _finish(bool ok);
+
+protected slots:
+    void sshDataReceived();
+
+public:
+    SshScpGet(SshClient * client, QString source, QString dest);
+    SshScpGet(SshClient * client, QString source, QIODevice *device);
+    virtual ~SshScpGet();
+    bool get();
+
+    bool state() const;
+    QString destination() const;
+
+signals:
+    void channelOpened();
+    void progress(qint64 received, qint64 total);
+    void transfertTerminate();
+};
+
+#endif // SSHSCPGET_H
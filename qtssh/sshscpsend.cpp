@@ -1,83 +1,145 @@
 #include "sshscpsend.h"
 #include "sshclient.h"
 #include <QFileInfo>
+#include <QFile>
 #include <qdebug.h>
 
+/* Never refill with less than a full ssh packet */
+#define SCP_MIN_CHUNK (32 * 1024)
+#define SCP_BUFFER_LEN (512 * 1024)
+
 bool SshScpSend::state() const
 {
     return _state;
 }
 
+void SshScpSend::_waitSocket()
+{
+    /* Outgoing data blocked on the socket : no ssh data will wake us up, retry shortly */
+    if(libssh2_session_block_directions(sshClient->session()) & LIBSSH2_SESSION_BLOCK_OUTBOUND)
+    {
+        _retry.start();
+    }
+}
+
+void SshScpSend::_pump()
+{
+    while(_currentState == ScpCopy)
+    {
+        if(_pending == 0)
+        {
+            /* Refill with what the remote window can take at once, within the buffer */
+            size_t window = libssh2_channel_window_write(sshChannel);
+            size_t chunk = qBound<size_t>(SCP_MIN_CHUNK, window, size_t(_buffer.size()));
+            _pending = fread(_buffer.data(), 1, chunk, _local);
+            _offset = 0;
+            if(_pending == 0)
+            {
+                _currentState = (ferror(_local))?(ScpError):(ScpEof);
+                if(_currentState == ScpError) qDebug() << "ERROR : Read error on " << _source;
+                return;
+            }
+        }
+        if(libssh2_channel_window_write(sshChannel) == 0)
+        {
+            /* Wait for a window adjust */
+            return;
+        }
+        ssize_t rc = libssh2_channel_write(sshChannel, _buffer.constData() + _offset, _pending);
+        if(rc == LIBSSH2_ERROR_EAGAIN)
+        {
+            _waitSocket();
+            return;
+        }
+        if(rc < 0)
+        {
+            qDebug() << "ERROR : Copy error " << rc;
+            _currentState = ScpError;
+            return;
+        }
+        _offset  += size_t(rc);
+        _pending -= size_t(rc);
+        emit data_tx(rc);
+    }
+}
+
 void SshScpSend::sshDataReceived()
 {
-    static char mem[1024];
-    static size_t nread;
-    static char *ptr;
     int rc;
 
     switch(_currentState)
     {
     case ScpPrepare:
         if(!sshChannel) {
-            sshChannel = libssh2_scp_send(sshClient->session(), qPrintable(_destination), _fileinfo.st_mode & 0777, (unsigned long)_fileinfo.st_size);
+            LIBSSH2_SESSION *session = sshClient->session();
+            QByteArray remote = _remoteFile.toLocal8Bit();
+            int mode = _fileinfo.st_mode & 0777;
+            unsigned long size = (unsigned long)_fileinfo.st_size;
+            if(!sshClient->lockChannelOpen(this, [session, remote, mode, size]() {
+                    LIBSSH2_CHANNEL *channel = libssh2_scp_send(session, remote.constData(), mode, size);
+                    if(channel)
+                    {
+                        libssh2_channel_close(channel);
+                        libssh2_channel_free(channel);
+                    }
+                    return channel != NULL || libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN;
+                }))
+            {
+                break;
+            }
+            sshChannel = libssh2_scp_send(session, remote.constData(), mode, size);
+            if(sshChannel || libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN) {
+                sshClient->unlockChannelOpen(this);
+            }
 
             if ((!sshChannel) && (libssh2_session_last_errno(sshClient->session()) != LIBSSH2_ERROR_EAGAIN)) {
                 char *errmsg;
                 int errlen;
                 libssh2_session_last_error(sshClient->session(), &errmsg, &errlen, 0);
                 qDebug() << "ERROR : Unable to open a session: " << errmsg;
+                _currentState = ScpError;
+                sshDataReceived();
+                break;
             }
-            if(sshChannel) {
+        }
+        if(sshChannel) {
 #ifdef DEBUG_SCPSEND
-                qDebug() << "DEBUG : ScpPrepare Send Accepted";
+            qDebug() << "DEBUG : ScpPrepare Send Accepted";
 #endif
-                _currentState = ScpCopy;
-            }
+            _currentState = ScpCopy;
+            emit channelOpened();
+            sshDataReceived();
         }
         break;
 
     case ScpCopy:
-        do {
-            nread = fread(mem, 1, sizeof(mem), _local);
-            if (nread <= 0) {
-                /* end of file */
-                _currentState = ScpEof;
-                sshDataReceived();
-                break;
-            }
-            ptr = mem;
-            do {
-                /* write the same data over and over, until error or completion */
-                rc = libssh2_channel_write(sshChannel, ptr, nread);
-
-                if (rc < 0) {
-                    qDebug() << "ERROR : Copy error " << rc;
-                    _currentState = ScpError;
-                    break;
-                }
-                else {
-                    /* rc indicates how many bytes were written this time */
-                    ptr += rc;
-                    nread -= rc;
-                }
-            } while (nread);
-        } while(1);
+        _pump();
+        if(_currentState != ScpCopy) sshDataReceived();
         break;
+
     case ScpEof:
 #ifdef DEBUG_SCPSEND
         qDebug() << "DEBUG : Sending EOF";
 #endif
-        libssh2_channel_send_eof(sshChannel);
+        rc = libssh2_channel_send_eof(sshChannel);
+        if(rc == LIBSSH2_ERROR_EAGAIN)
+        {
+            _waitSocket();
+            break;
+        }
         _currentState = ScpClose;
+        sshDataReceived();
         break;
 
     case ScpClose:
 #ifdef DEBUG_SCPSEND
         qDebug() << "DEBUG : Waiting EOF";
 #endif
-        libssh2_channel_wait_eof(sshChannel);
+        if(libssh2_channel_wait_eof(sshChannel) == LIBSSH2_ERROR_EAGAIN) break;
         _state = true;
         _currentState = ScpEnd;
+        fclose(_local);
+        _local = NULL;
         stopChannel();
         emit transfertTerminate();
         break;
@@ -85,6 +147,12 @@ void SshScpSend::sshDataReceived()
     case ScpError:
         qDebug() << "ERROR : SCP ERROR";
         _state = false;
+        _currentState = ScpEnd;
+        if(_local)
+        {
+            fclose(_local);
+            _local = NULL;
+        }
         stopChannel();
         emit transfertTerminate();
         break;
@@ -100,43 +168,47 @@ void SshScpSend::sshDataReceived()
 SshScpSend::SshScpSend(SshClient *client, QString source, QString dest):
     SshChannel(client),
     _source(source),
-    _destination(dest)
+    _destination(dest),
+    _currentState(ScpPrepare),
+    _local(NULL),
+    _state(false),
+    _buffer(SCP_BUFFER_LEN, 0),
+    _offset(0),
+    _pending(0)
 {
-    QObject::connect(client, &SshClient::sshDataReceived, this, &SshScpSend::sshDataReceived);
+    /* SshChannel already connects sshDataReceived */
+    _retry.setSingleShot(true);
+    _retry.setInterval(10);
+    QObject::connect(&_retry, &QTimer::timeout, this, &SshScpSend::sshDataReceived);
 }
 
 QString SshScpSend::send()
 {
     QFileInfo src(_source);
 
-    const char *loclfile=qPrintable(src.absoluteFilePath());
+    QByteArray loclfile = QFile::encodeName(src.absoluteFilePath());
 
     _currentState = ScpPrepare;
 
-    _local = fopen(loclfile, "rb");
-    if (!_local) {
+    _local = fopen(loclfile.constData(), "rb");
+    if (!_local || fstat(fileno(_local), &_fileinfo) != 0) {
         qDebug() << "ERROR : Can't open local file " << loclfile;
+        if(_local) fclose(_local);
+        _local = NULL;
+        _currentState = ScpEnd;
         return "";
     }
 
-    stat(loclfile, &_fileinfo);
-
     /* Send a file via scp. The mode parameter must only have permissions! */
 #ifdef DEBUG_SCPSEND
     qDebug() << "DEBUG : Send to " << qPrintable(_destination + "/" + src.fileName());
 #endif
-    sshChannel = libssh2_scp_send(sshClient->session(), qPrintable(_destination + src.fileName()), _fileinfo.st_mode & 0777, (unsigned long)_fileinfo.st_size);
-
-    if ((!sshChannel) && (libssh2_session_last_errno(sshClient->session()) != LIBSSH2_ERROR_EAGAIN)) {
-        char *errmsg;
-        int errlen;
-        libssh2_session_last_error(sshClient->session(), &errmsg, &errlen, 0);
-        qDebug() << "ERROR : Unable to open a session: " << errmsg;
-        _currentState = ScpError;
-    }
+    _remoteFile = _destination + src.fileName();
+    /* The channel is opened by the state machine, without waiting for incoming ssh data */
+    QTimer::singleShot(0, this, SLOT(sshDataReceived()));
 #ifdef DEBUG_SCPSEND
     qDebug() << "DEBUG : End of send function";
 #endif
-    return _destination + src.fileName();
+    return _remoteFile;
 }
 
@@ -3,6 +3,7 @@
 
 
 #include "sshchannel.h"
+#include <QTimer>
 
 enum SshScpSendState {
     ScpError = 0,
@@ -13,16 +14,31 @@ enum SshScpSendState {
     ScpEnd = 5
 };
 
+/*
+ * Send one file with scp. All the transfer state is held by the instance :
+ * several transfers can run at once on a session, see SshClient::sendFiles().
+ * Channel opening is not reentrant in libssh2 : the open waits for the
+ * session open lock (SshClient::lockChannelOpen), channelOpened() tells
+ * when the next transfer may open its own.
+ */
 class SshScpSend : public SshChannel
 {
     Q_OBJECT
 
     QString _source;
     QString _destination;
+    QString _remoteFile;
     SshScpSendState _currentState;
     FILE *_local;
     struct stat _fileinfo;
     bool _state;
+    QByteArray _buffer;
+    size_t _offset;
+    size_t _pending;
+    QTimer _retry;
+
+    void _pump();
+    void _waitSocket();
 
 protected slots:
     void sshDataReceived();
@@ -34,6 +50,7 @@ public:
     bool state() const;
 
 signals:
+    void channelOpened();
     void transfertTerminate();
 };
 
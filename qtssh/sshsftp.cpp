@@ -4,6 +4,9 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QCryptographicHash>
+#include <string.h>
+#include <utime.h>
+#include <stdio.h>
 
 QString SshSFtp::send(QString source, QString dest)
 {
@@ -300,6 +303,354 @@ quint64 SshSFtp::filesize(QString d)
     return getFileInfo(d).filesize;
 }
 
+LIBSSH2_SFTP_HANDLE *SshSFtp::openFile(QString path, unsigned long flags, long mode)
+{
+    LIBSSH2_SFTP_HANDLE *sftpfile;
+    int rc;
+
+    do {
+        sftpfile = libssh2_sftp_open(_sftpSession, qPrintable(path), flags, mode);
+        rc = libssh2_session_last_errno(sshClient->session());
+        if (!sftpfile && (rc == LIBSSH2_ERROR_EAGAIN))
+        {
+            _waitData(2000);
+        }
+        else if(!sftpfile)
+        {
+#ifdef DEBUG_SFTP
+            qDebug() << "DEBUG : openFile(" << path << ") error " << rc;
+#endif
+            return NULL;
+        }
+    } while (!sftpfile);
+    return sftpfile;
+}
+
+void SshSFtp::closeFile(LIBSSH2_SFTP_HANDLE *handle)
+{
+    if(!handle) return;
+    while(libssh2_sftp_close(handle) == LIBSSH2_ERROR_EAGAIN)
+    {
+        _waitData(2000);
+    }
+}
+
+bool SshSFtp::stat(QString path, LIBSSH2_SFTP_ATTRIBUTES &attrs)
+{
+    int status;
+    while((status = libssh2_sftp_stat(_sftpSession, qPrintable(path), &attrs)) == LIBSSH2_ERROR_EAGAIN)
+    {
+        _waitData(2000);
+    }
+    return (status == 0);
+}
+
+bool SshSFtp::fstat(LIBSSH2_SFTP_HANDLE *handle, LIBSSH2_SFTP_ATTRIBUTES &attrs)
+{
+    int status;
+    while((status = libssh2_sftp_fstat(handle, &attrs)) == LIBSSH2_ERROR_EAGAIN)
+    {
+        _waitData(2000);
+    }
+    return (status == 0);
+}
+
+qint64 SshSFtp::read(LIBSSH2_SFTP_HANDLE *handle, quint64 offset, char *buffer, qint64 len)
+{
+    qint64 total = 0;
+    ssize_t rc;
+
+    libssh2_sftp_seek64(handle, offset);
+    while(total < len)
+    {
+        rc = libssh2_sftp_read(handle, buffer + total, len - total);
+        if(rc == LIBSSH2_ERROR_EAGAIN)
+        {
+            _waitData(1000);
+            continue;
+        }
+        if(rc < 0)
+        {
+            qDebug() << "ERROR : read error at offset " << offset + total << " = " << rc;
+            return (total > 0)?(total):(-1);
+        }
+        if(rc == 0)
+        {
+            /* end of file */
+            break;
+        }
+        total += rc;
+    }
+    return total;
+}
+
+QMap<QString, LIBSSH2_SFTP_ATTRIBUTES> SshSFtp::readdirAttributes(QString d)
+{
+    int rc;
+    QMap<QString, LIBSSH2_SFTP_ATTRIBUTES> result;
+    LIBSSH2_SFTP_HANDLE *sftpdir = getDirHandler(qPrintable(d));
+    QByteArray buffer(512,0);
+
+    if(!sftpdir) return result;
+
+    do {
+        LIBSSH2_SFTP_ATTRIBUTES attrs;
+
+        while ((rc = libssh2_sftp_readdir(sftpdir, buffer.data(), buffer.size(), &attrs)) == LIBSSH2_ERROR_EAGAIN)
+        {
+            _waitData(2000);
+        }
+        if(rc <= 0) {
+            break;
+        }
+        QString name = QString::fromUtf8(buffer.constData(), rc);
+        if(name != "." && name != "..")
+        {
+            result.insert(name, attrs);
+        }
+    } while (1);
+    closeDirHandler(qPrintable(d));
+    return result;
+}
+
+void SshSFtp::invalidateFileInfo(QString path)
+{
+    _fileinfo.remove(path);
+}
+
+bool SshSFtp::rmdir(QString d)
+{
+    int res;
+
+    closeDirHandler(d);
+    while((res = libssh2_sftp_rmdir(_sftpSession, qPrintable(d))) == LIBSSH2_ERROR_EAGAIN)
+    {
+        _waitData(2000);
+    }
+    if(res != 0)
+    {
+        qDebug() << "ERROR : rmdir " << d << " error, result = " << res;
+    }
+    return (res == 0);
+}
+
+bool SshSFtp::setMtime(QString path, quint64 mtime)
+{
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    int res;
+
+    memset(&attrs, 0, sizeof(attrs));
+    attrs.flags = LIBSSH2_SFTP_ATTR_ACMODTIME;
+    attrs.atime = mtime;
+    attrs.mtime = mtime;
+    while((res = libssh2_sftp_setstat(_sftpSession, qPrintable(path), &attrs)) == LIBSSH2_ERROR_EAGAIN)
+    {
+        _waitData(2000);
+    }
+    _fileinfo.remove(path);
+    return (res == 0);
+}
+
+bool SshSFtp::rename(QString source, QString dest)
+{
+    QByteArray src = source.toUtf8();
+    QByteArray dst = dest.toUtf8();
+    int res;
+
+    while((res = libssh2_sftp_rename_ex(_sftpSession, src.constData(), unsigned(src.size()), dst.constData(), unsigned(dst.size()),
+                                        LIBSSH2_SFTP_RENAME_OVERWRITE | LIBSSH2_SFTP_RENAME_ATOMIC | LIBSSH2_SFTP_RENAME_NATIVE)) == LIBSSH2_ERROR_EAGAIN)
+    {
+        _waitData(2000);
+    }
+    if(res != 0 && isFile(dest))
+    {
+        /* sftp v3 servers refuse to rename over an existing file */
+        unlink(dest);
+        while((res = libssh2_sftp_rename_ex(_sftpSession, src.constData(), unsigned(src.size()), dst.constData(), unsigned(dst.size()), 0)) == LIBSSH2_ERROR_EAGAIN)
+        {
+            _waitData(2000);
+        }
+    }
+    _fileinfo.remove(source);
+    _fileinfo.remove(dest);
+    if(res != 0)
+    {
+        qDebug() << "ERROR : rename " << source << " to " << dest << " error, result = " << res;
+    }
+    return (res == 0);
+}
+
+/* Hidden name in the destination directory, so the final rename stays on one filesystem */
+static QString transferTempName(const QString &path)
+{
+    int slash = path.lastIndexOf('/');
+    return path.left(slash + 1) + "." + path.mid(slash + 1) + SFTP_TEMP_SUFFIX;
+}
+
+struct SshSFtpTransferSlot {
+    int job;
+    QString temp;
+    QFile *file;
+    LIBSSH2_SFTP_HANDLE *handle;
+    QByteArray buffer;
+    qint64 len;
+    qint64 pos;
+};
+
+bool SshSFtp::transfer(QList<SshSFtpTransfer> &jobs, int parallel)
+{
+    QList<SshSFtpTransferSlot> active;
+    int next = 0;
+    bool res = true;
+
+    if(parallel < 1) parallel = 1;
+
+    while(next < jobs.size() || !active.isEmpty())
+    {
+        /* Opening is serialized : libssh2 keeps a single open state per sftp session */
+        while(active.size() < parallel && next < jobs.size())
+        {
+            SshSFtpTransfer &job = jobs[next];
+            SshSFtpTransferSlot slot;
+            slot.job = next++;
+            slot.len = 0;
+            slot.pos = 0;
+            job.ok = false;
+
+            bool upload = (job.direction == SshSFtpTransfer::Upload);
+            slot.temp = transferTempName((upload)?(job.remote):(job.local));
+            slot.file = new QFile((upload)?(job.local):(slot.temp));
+            if(!slot.file->open((upload)?(QIODevice::ReadOnly):(QIODevice::WriteOnly | QIODevice::Truncate)))
+            {
+                qDebug() << "ERROR : Can't open file " << job.local;
+                delete slot.file;
+                res = false;
+                continue;
+            }
+            if(upload)
+            {
+                slot.handle = openFile(slot.temp, LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC,
+                                       LIBSSH2_SFTP_S_IRUSR|LIBSSH2_SFTP_S_IWUSR|LIBSSH2_SFTP_S_IRGRP|LIBSSH2_SFTP_S_IROTH);
+            }
+            else
+            {
+                slot.handle = openFile(job.remote, LIBSSH2_FXF_READ);
+            }
+            if(!slot.handle)
+            {
+                qDebug() << "ERROR : Can't open remote file " << job.remote;
+                if(!upload) slot.file->remove();
+                delete slot.file;
+                res = false;
+                continue;
+            }
+            slot.buffer.resize(1024 * 100);
+            active.append(slot);
+        }
+
+        /* Interleave reads and writes of every opened file on the sftp session */
+        bool progress = false;
+        for(int i = 0; i < active.size(); ++i)
+        {
+            SshSFtpTransferSlot &slot = active[i];
+            SshSFtpTransfer &job = jobs[slot.job];
+            bool done = false;
+            bool failed = false;
+            ssize_t rc;
+
+            if(job.direction == SshSFtpTransfer::Upload)
+            {
+                if(slot.pos == slot.len)
+                {
+                    slot.len = slot.file->read(slot.buffer.data(), slot.buffer.size());
+                    slot.pos = 0;
+                    if(slot.len < 0) failed = true;
+                    else if(slot.len == 0) done = true;
+                }
+                if(!done && !failed)
+                {
+                    rc = libssh2_sftp_write(slot.handle, slot.buffer.constData() + slot.pos, slot.len - slot.pos);
+                    if(rc >= 0)
+                    {
+                        slot.pos += rc;
+                        progress = true;
+                    }
+                    else if(rc != LIBSSH2_ERROR_EAGAIN)
+                    {
+                        qDebug() << "ERROR : Write error " << job.remote << " = " << rc;
+                        failed = true;
+                    }
+                }
+            }
+            else
+            {
+                rc = libssh2_sftp_read(slot.handle, slot.buffer.data(), slot.buffer.size());
+                if(rc > 0)
+                {
+                    failed = (slot.file->write(slot.buffer.constData(), rc) != rc);
+                    progress = true;
+                }
+                else if(rc == 0)
+                {
+                    done = true;
+                }
+                else if(rc != LIBSSH2_ERROR_EAGAIN)
+                {
+                    qDebug() << "ERROR : Read error " << job.remote << " = " << rc;
+                    failed = true;
+                }
+            }
+
+            if(done || failed)
+            {
+                closeFile(slot.handle);
+                slot.file->close();
+                delete slot.file;
+                bool upload = (job.direction == SshSFtpTransfer::Upload);
+                if(done && job.mtime)
+                {
+                    if(upload)
+                    {
+                        setMtime(slot.temp, job.mtime);
+                    }
+                    else
+                    {
+                        struct utimbuf times;
+                        times.actime  = time_t(job.mtime);
+                        times.modtime = time_t(job.mtime);
+                        utime(QFile::encodeName(slot.temp).constData(), &times);
+                    }
+                }
+                /* Only a complete copy replaces the destination */
+                if(done)
+                {
+                    if(upload) done = rename(slot.temp, job.remote);
+                    else done = (::rename(QFile::encodeName(slot.temp).constData(), QFile::encodeName(job.local).constData()) == 0);
+                }
+                if(!done)
+                {
+                    if(upload) unlink(slot.temp);
+                    else QFile::remove(slot.temp);
+                }
+                job.ok = done;
+                res = res && done;
+                active.removeAt(i--);
+                progress = true;
+            }
+        }
+
+        if(progress)
+        {
+            emit xfer();
+        }
+        else if(!active.isEmpty())
+        {
+            _waitData(1000);
+        }
+    }
+    return res;
+}
+
 void SshSFtp::sshDataReceived()
 {
     emit sshData();
@@ -378,6 +729,11 @@ SshSFtp::SshSFtp(SshClient *client):
 {
     QObject::connect(client, &SshClient::sshDataReceived, this, &SshSFtp::sshDataReceived);
 
+    /* sftp_init opens a session channel : wait for the other opens to finish */
+    while(!sshClient->lockChannelOpen(this))
+    {
+        _waitData(2000);
+    }
     while(!(_sftpSession = libssh2_sftp_init(sshClient->session())))
     {
         if(libssh2_session_last_errno(sshClient->session()) == LIBSSH2_ERROR_EAGAIN)
@@ -392,6 +748,7 @@ SshSFtp::SshSFtp(SshClient *client):
             break;
         }
     }
+    sshClient->unlockChannelOpen(this);
     if(!_sftpSession)
     {
         qDebug() << "LAST ERROR IS : " << libssh2_session_last_errno(sshClient->session());
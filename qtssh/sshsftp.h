@@ -7,8 +7,24 @@
 #include <QTimer>
 #include <QStringList>
 #include <QHash>
+#include <QMap>
 #include "sshfsinterface.h"
 
+/* Suffix of the files transfer() writes before renaming them */
+#define SFTP_TEMP_SUFFIX ".qtssh-tmp"
+
+struct SshSFtpTransfer {
+    enum Direction {
+        Upload,
+        Download
+    };
+    Direction direction;
+    QString local;
+    QString remote;
+    quint64 mtime;
+    bool ok;
+};
+
 class SshSFtp : public SshChannel, public SshFsInterface
 {
     Q_OBJECT
@@ -44,6 +60,23 @@ public:
     quint64 filesize(QString d);
     /* >>>SshFsInterface<<< */
 
+    LIBSSH2_SFTP_HANDLE *openFile(QString path, unsigned long flags, long mode = 0);
+    void closeFile(LIBSSH2_SFTP_HANDLE *handle);
+    bool stat(QString path, LIBSSH2_SFTP_ATTRIBUTES &attrs);
+    bool fstat(LIBSSH2_SFTP_HANDLE *handle, LIBSSH2_SFTP_ATTRIBUTES &attrs);
+    qint64 read(LIBSSH2_SFTP_HANDLE *handle, quint64 offset, char *buffer, qint64 len);
+    QMap<QString, LIBSSH2_SFTP_ATTRIBUTES> readdirAttributes(QString d);
+    void invalidateFileInfo(QString path);
+    bool rmdir(QString d);
+    bool setMtime(QString path, quint64 mtime);
+    bool rename(QString source, QString dest);
+    /*
+     * Files are written under a temporary name next to their destination
+     * and renamed over it once complete : a failed job leaves the previous
+     * copy untouched.
+     */
+    bool transfer(QList<SshSFtpTransfer> &jobs, int parallel = 4);
+
 protected slots:
     void sshDataReceived();
 
@@ -0,0 +1,194 @@
+#include "sshsftpfollow.h"
+#include "sshsftp.h"
+#include <QDebug>
+
+#define FOLLOW_BUFFER_LEN (256 * 1024)
+/* Lowest poll interval : 0 would poll the server in a tight loop */
+#define FOLLOW_MIN_INTERVAL 10
+
+SshSFtpFollow::SshSFtpFollow(SshSFtp *sftp, QString path, bool fromStart):
+    QObject(sftp),
+    _sftp(sftp),
+    _path(path),
+    _handle(NULL),
+    _offset(0),
+    _minInterval(100),
+    _maxInterval(5000),
+    _buffer(FOLLOW_BUFFER_LEN, 0)
+{
+    _timer.setSingleShot(true);
+    _timer.setInterval(_minInterval);
+    QObject::connect(&_timer, &QTimer::timeout, this, &SshSFtpFollow::_poll);
+
+    if(!_open(fromStart))
+    {
+        qDebug() << "WARNING : SshSFtpFollow : can't open " << _path << ", will retry";
+    }
+}
+
+SshSFtpFollow::~SshSFtpFollow()
+{
+    _timer.stop();
+    _close();
+}
+
+QString SshSFtpFollow::path() const
+{
+    return _path;
+}
+
+quint64 SshSFtpFollow::offset() const
+{
+    return _offset;
+}
+
+void SshSFtpFollow::setPollInterval(int min, int max)
+{
+    _minInterval = qMax(min, FOLLOW_MIN_INTERVAL);
+    _maxInterval = qMax(max, _minInterval);
+    _timer.setInterval(_minInterval);
+}
+
+void SshSFtpFollow::start()
+{
+    _timer.start(_minInterval);
+}
+
+void SshSFtpFollow::stop()
+{
+    _timer.stop();
+}
+
+bool SshSFtpFollow::_open(bool fromStart)
+{
+    _close();
+    _handle = _sftp->openFile(_path, LIBSSH2_FXF_READ);
+    if(!_handle)
+    {
+        return false;
+    }
+    if(!_sftp->fstat(_handle, _attrs))
+    {
+        _close();
+        return false;
+    }
+    _offset = (fromStart)?(0):(_attrs.filesize);
+#if defined(DEBUG_SFTP)
+    qDebug() << "DEBUG : SshSFtpFollow : " << _path << " opened at offset " << _offset;
+#endif
+    return true;
+}
+
+void SshSFtpFollow::_close()
+{
+    if(_handle)
+    {
+        _sftp->closeFile(_handle);
+        _handle = NULL;
+    }
+}
+
+bool SshSFtpFollow::_readNewData()
+{
+    bool received = false;
+
+    if(!_sftp->fstat(_handle, _attrs))
+    {
+        return false;
+    }
+
+    if(_attrs.filesize < _offset)
+    {
+        /* File truncated in place (copytruncate rotation) */
+#if defined(DEBUG_SFTP)
+        qDebug() << "DEBUG : SshSFtpFollow : " << _path << " truncated";
+#endif
+        _offset = 0;
+        emit rotated();
+    }
+
+    while(_offset < _attrs.filesize)
+    {
+        qint64 len = qMin<quint64>(_buffer.size(), _attrs.filesize - _offset);
+        qint64 rc = _sftp->read(_handle, _offset, _buffer.data(), len);
+        if(rc <= 0)
+        {
+            break;
+        }
+        _offset += rc;
+        received = true;
+        emit dataReceived(QByteArray(_buffer.constData(), int(rc)));
+    }
+    return received;
+}
+
+bool SshSFtpFollow::_replaced()
+{
+    /* SFTPv3 does not expose inode numbers, and libssh2 has no other file
+     * identity. The path is stat'ed before the handle : an append landing
+     * in between only makes the handle larger. So the path names another
+     * file when it is shorter than what was read, larger than the handle,
+     * or owned differently. Size and mtime equality are not compared, they
+     * change with every append. */
+    LIBSSH2_SFTP_ATTRIBUTES pathAttrs;
+    if(!_sftp->stat(_path, pathAttrs))
+    {
+        return true;
+    }
+    if(!_sftp->fstat(_handle, _attrs))
+    {
+        return true;
+    }
+    return (pathAttrs.filesize    <  _offset)
+        || (pathAttrs.filesize    >  _attrs.filesize)
+        || (pathAttrs.permissions != _attrs.permissions)
+        || (pathAttrs.uid         != _attrs.uid)
+        || (pathAttrs.gid         != _attrs.gid);
+}
+
+void SshSFtpFollow::_poll()
+{
+    int interval = _timer.interval();
+
+    if(!_handle)
+    {
+        /* Waiting for the file to (re)appear */
+        if(_open(true))
+        {
+            emit rotated();
+            interval = _minInterval;
+        }
+        else
+        {
+            interval = qMin(interval * 2, _maxInterval);
+        }
+    }
+    else if(_readNewData())
+    {
+        interval = _minInterval;
+    }
+    else if(_replaced())
+    {
+        /* Drain what was appended to the old file before switching */
+        _readNewData();
+#if defined(DEBUG_SFTP)
+        qDebug() << "DEBUG : SshSFtpFollow : " << _path << " rotated";
+#endif
+        if(_open(true))
+        {
+            emit rotated();
+            _readNewData();
+        }
+        else
+        {
+            emit error(_path);
+        }
+        interval = _minInterval;
+    }
+    else
+    {
+        interval = qMin(interval * 2, _maxInterval);
+    }
+
+    _timer.start(interval);
+}
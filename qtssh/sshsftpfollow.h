@@ -0,0 +1,63 @@
+#ifndef SSHSFTPFOLLOW_H
+#define SSHSFTPFOLLOW_H
+
+#include <QObject>
+#include <QTimer>
+#include <QByteArray>
+#include <libssh2.h>
+#include <libssh2_sftp.h>
+
+class SshSFtp;
+
+/*
+ * Follow a remote file like "tail -f" : the file stays opened, its size is
+ * polled with fstat and only the appended bytes are read. The poll interval
+ * grows while the file is idle and falls back to the minimum on new data,
+ * never below 10 ms.
+ * When the file is truncated or replaced (log rotation), it is reopened and
+ * read from the beginning. Without inode numbers in SFTPv3, a replacement
+ * is told by its size and owner : a new file of the same owner that is
+ * already as large as the old one is only noticed once it grows.
+ */
+class SshSFtpFollow : public QObject
+{
+    Q_OBJECT
+
+    SshSFtp *_sftp;
+    QString _path;
+    LIBSSH2_SFTP_HANDLE *_handle;
+    LIBSSH2_SFTP_ATTRIBUTES _attrs;
+    quint64 _offset;
+    QTimer _timer;
+    int _minInterval;
+    int _maxInterval;
+    QByteArray _buffer;
+
+public:
+    explicit SshSFtpFollow(SshSFtp *sftp, QString path, bool fromStart = false);
+    virtual ~SshSFtpFollow();
+
+    QString path() const;
+    quint64 offset() const;
+    void setPollInterval(int min, int max);
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void dataReceived(QByteArray data);
+    void rotated();
+    void error(QString path);
+
+private slots:
+    void _poll();
+
+private:
+    bool _open(bool fromStart);
+    void _close();
+    bool _readNewData();
+    bool _replaced();
+};
+
+#endif // SSHSFTPFOLLOW_H
@@ -0,0 +1,143 @@
+#include "sshshell.h"
+#include "sshclient.h"
+#include "sshprocess.h"
+#include "sshcommand.h"
+#include "sshutils.h"
+#include <QDebug>
+
+SshShell::SshShell(SshClient *client, QString shell):
+    QObject(client),
+    _client(client),
+    _shell(shell),
+    _parser(new SshSentinelParser()),
+    _process(NULL),
+    _started(false),
+    _nextId(0)
+{
+}
+
+SshShell::~SshShell()
+{
+    /* Commands are children : they are deleted after this */
+    foreach(SshCommand *cmd, _running)
+    {
+        if(cmd) cmd->_shell = NULL;
+    }
+    delete _process;
+    delete _parser;
+}
+
+int SshShell::pending() const
+{
+    return _running.size() - _running.count(NULL);
+}
+
+void SshShell::_startShell()
+{
+    _started = false;
+    _process = new SshProcess(_client);
+    QObject::connect(_process, &SshProcess::connected, this, &SshShell::_shellStarted);
+    QObject::connect(_process, &SshProcess::readyReadStandardOutput, this, &SshShell::_stdoutData);
+    QObject::connect(_process, &SshProcess::readyReadStandardError, this, &SshShell::_stderrData);
+    QObject::connect(_process, &SshProcess::finished, this, &SshShell::_shellFinished);
+    QObject::connect(_process, &SshProcess::channelOpenFailed, this, &SshShell::_shellFinished);
+    _process->start(_shell);
+}
+
+SshCommand *SshShell::run(QString command)
+{
+    SshCommand *cmd = new SshCommand(command, this);
+    cmd->_shell = this;
+    cmd->setTimeout(_client->commandTimeout());
+    quint64 id = _nextId++;
+    QByteArray frame = _parser->frame(id, command);
+
+    _running << cmd;
+    _parser->expect(id);
+    if(!_process) _startShell();
+    if(_started) _process->write(frame);
+    else _input.append(frame);
+    return cmd;
+}
+
+QString SshShell::runCommand(QString command)
+{
+    SshCommand *cmd = run(command);
+    cmd->waitForFinished();
+    QString res = cmd->result();
+    cmd->deleteLater();
+    return res;
+}
+
+void SshShell::_shellStarted()
+{
+#if defined(DEBUG_SSHCHANNEL)
+    qDebug() << "DEBUG : SshShell : " << _shell << " started";
+#endif
+    _started = true;
+    if(!_input.isEmpty())
+    {
+        /* Commands queued while the channel was opening */
+        _process->write(_input);
+        _input.clear();
+    }
+}
+
+void SshShell::_stdoutData()
+{
+    _parser->parseOutput(_process->readAllStandardOutput());
+    _complete();
+}
+
+void SshShell::_stderrData()
+{
+    _parser->parseError(_process->readAllStandardError());
+    _complete();
+}
+
+void SshShell::_complete()
+{
+    SshSentinelParser::Entry entry;
+    while(_parser->takeFinished(entry))
+    {
+        SshCommand *cmd = _running.takeFirst();
+        /* Canceled or deleted : its frame is only consumed */
+        if(!cmd) continue;
+        cmd->_shell = NULL;
+        cmd->_output = entry.output;
+        cmd->_errorOutput = entry.errorOutput;
+        cmd->_finish(entry.exitCode);
+    }
+}
+
+void SshShell::_shellFinished()
+{
+    qDebug() << "WARNING : SshShell : " << _shell << " terminated, " << pending() << " command(s) failed";
+    _process->deleteLater();
+    _process = NULL;
+    _started = false;
+    _input.clear();
+    _parser->reset();
+    /* A finished() handler may delete the next commands : take them one by one */
+    while(!_running.isEmpty())
+    {
+        SshCommand *cmd = _running.takeFirst();
+        if(!cmd) continue;
+        cmd->_shell = NULL;
+        cmd->_finish(-1);
+    }
+}
+
+void SshShell::_drop(SshCommand *cmd)
+{
+    int index = _running.indexOf(cmd);
+    if(index >= 0) _running[index] = NULL;
+    cmd->_shell = NULL;
+}
+
+void SshShell::_timedOut(SshCommand *cmd)
+{
+    qDebug() << "WARNING : SshShell : " << cmd->command() << " timed out, restarting " << _shell;
+    /* Commands behind a hung one would never run : end the shell, all of them fail */
+    if(_process) _process->cancel();
+}
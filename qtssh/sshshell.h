@@ -0,0 +1,56 @@
+#ifndef SSHSHELL_H
+#define SSHSHELL_H
+
+#include <QObject>
+#include <QList>
+#include <QByteArray>
+
+class SshClient;
+class SshProcess;
+class SshCommand;
+class SshSentinelParser;
+
+/*
+ * Persistent shell on a single exec channel. Commands are written to the
+ * shell one after another without waiting, each one followed by a sentinel
+ * on stdout (carrying the exit code) and on stderr : the output of both
+ * streams is split per command from those markers. Shell state (cwd,
+ * variables) is kept between commands, stdin of each command is /dev/null.
+ */
+class SshShell : public QObject
+{
+    Q_OBJECT
+
+    friend class SshCommand;
+
+    SshClient *_client;
+    QString _shell;
+    SshSentinelParser *_parser;
+    SshProcess *_process;
+    bool _started;
+    quint64 _nextId;
+    QByteArray _input;
+    QList<SshCommand *> _running;
+
+public:
+    explicit SshShell(SshClient *client, QString shell = "sh");
+    virtual ~SshShell();
+
+    SshCommand *run(QString command);
+    QString runCommand(QString command);
+    int pending() const;
+
+private slots:
+    void _shellStarted();
+    void _stdoutData();
+    void _stderrData();
+    void _shellFinished();
+
+private:
+    void _startShell();
+    void _drop(SshCommand *cmd);
+    void _timedOut(SshCommand *cmd);
+    void _complete();
+};
+
+#endif // SSHSHELL_H
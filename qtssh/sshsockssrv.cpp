@@ -0,0 +1,280 @@
+#include "sshsockssrv.h"
+#include "sshtunnelout.h"
+#include "sshclient.h"
+#include "sshutils.h"
+#include <QTcpSocket>
+#include <QTimer>
+#include <QHostAddress>
+
+#define SOCKS_HANDSHAKE_TIMEOUT (10 * 1000)
+#define HTTP_HEADER_MAX (8 * 1024)
+
+/* SOCKS5 reply, the bound address is not meaningful through ssh */
+static QByteArray socksReply(char code)
+{
+    QByteArray reply("\x05\x00\x00\x01\x00\x00\x00\x00\x00\x00", 10);
+    reply[1] = code;
+    return reply;
+}
+
+SshSocksSrv::SshSocksSrv(SshClient *client, QString port_identifier, quint16 bind):
+    SshChannel(client),
+    _sshclient(client),
+    _identifier(port_identifier),
+    _maxConnections(64),
+    _count(0),
+    _refused(0),
+    _failed(0),
+    _bytesReceived(0),
+    _bytesSent(0)
+{
+    _tcpserver = new QTcpServer(this);
+    _tcpserver->listen(QHostAddress("127.0.0.1"), bind);
+    connect(_tcpserver, SIGNAL(newConnection()), this, SLOT  (createConnection()));
+}
+
+SshSocksSrv::~SshSocksSrv()
+{
+    foreach (SshTunnelOut *tunnel, _connections) {
+        tunnel->deleteLater();
+    }
+    _tcpserver->close();
+    _tcpserver->deleteLater();
+}
+
+quint16 SshSocksSrv::localPort()
+{
+    return _tcpserver->serverPort();
+}
+
+void SshSocksSrv::setMaxConnections(int count)
+{
+    _maxConnections = qMax(1, count);
+}
+
+int SshSocksSrv::maxConnections() const
+{
+    return _maxConnections;
+}
+
+int SshSocksSrv::activeConnections() const
+{
+    return _connections.size();
+}
+
+int SshSocksSrv::totalConnections() const
+{
+    return _count;
+}
+
+int SshSocksSrv::refusedConnections() const
+{
+    return _refused;
+}
+
+int SshSocksSrv::failedConnections() const
+{
+    return _failed;
+}
+
+qint64 SshSocksSrv::bytesReceived() const
+{
+    qint64 total = _bytesReceived;
+    foreach (SshTunnelOut *tunnel, _connections) {
+        total += tunnel->bytesReceived();
+    }
+    return total;
+}
+
+qint64 SshSocksSrv::bytesSent() const
+{
+    qint64 total = _bytesSent;
+    foreach (SshTunnelOut *tunnel, _connections) {
+        total += tunnel->bytesSent();
+    }
+    return total;
+}
+
+void SshSocksSrv::createConnection()
+{
+    while(_tcpserver->hasPendingConnections())
+    {
+        QTcpSocket *socket = _tcpserver->nextPendingConnection();
+
+        if(!_sshclient->channelReady() || _connections.size() + _handshakes.size() >= _maxConnections)
+        {
+            qDebug() << "WARNING : SshSocksSrv(" << _identifier << ") : connection refused, " << _connections.size() << " active";
+            _refused++;
+            _refuse(socket, QByteArray());
+            continue;
+        }
+
+        /* A client that never completes its request is dropped */
+        Handshake handshake;
+        handshake.timer = new QTimer(socket);
+        handshake.timer->setSingleShot(true);
+        handshake.greeted = false;
+        _handshakes.insert(socket, handshake);
+        connect(handshake.timer, &QTimer::timeout, this, [this, socket](){
+            _refuse(socket, QByteArray());
+        });
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket](){
+            _handshake(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket](){
+            _endHandshake(socket);
+            socket->deleteLater();
+        });
+        handshake.timer->start(SOCKS_HANDSHAKE_TIMEOUT);
+        _handshake(socket);
+    }
+}
+
+void SshSocksSrv::_handshake(QTcpSocket *socket)
+{
+    char version;
+
+    if(!_handshakes.contains(socket) || socket->peek(&version, 1) != 1)
+    {
+        return;
+    }
+    if(version == 0x05)
+    {
+        while(_handshakes.contains(socket) && _socks5(socket));
+    }
+    else if(version >= 'A' && version <= 'Z')
+    {
+        _httpConnect(socket);
+    }
+    else
+    {
+        qDebug() << "WARNING : SshSocksSrv(" << _identifier << ") : unknown protocol";
+        _refuse(socket, QByteArray());
+    }
+}
+
+bool SshSocksSrv::_socks5(QTcpSocket *socket)
+{
+    QByteArray data = socket->peek(socket->bytesAvailable());
+    int length;
+
+    if(!_handshakes[socket].greeted)
+    {
+        bool noAuth = false;
+        length = socks5ParseGreeting(data, noAuth);
+        if(length == 0) return false;
+        socket->read(length);
+        if(!noAuth)
+        {
+            _refuse(socket, QByteArray("\x05\xff", 2));
+            return false;
+        }
+        socket->write(QByteArray("\x05\x00", 2));
+        _handshakes[socket].greeted = true;
+        return true;
+    }
+
+    char command = 0;
+    QString host;
+    quint16 port = 0;
+    length = socks5ParseRequest(data, command, host, port);
+    if(length == 0) return false;
+    if(length < 0)
+    {
+        _refuse(socket, socksReply(0x08));
+        return false;
+    }
+    socket->read(length);
+
+    if(command != 0x01)
+    {
+        /* Only CONNECT : no BIND nor UDP ASSOCIATE through direct-tcpip */
+        _refuse(socket, socksReply(0x07));
+        return false;
+    }
+    _openTunnel(socket, host, port, false);
+    return false;
+}
+
+bool SshSocksSrv::_httpConnect(QTcpSocket *socket)
+{
+    QByteArray data = socket->peek(HTTP_HEADER_MAX);
+    QString host;
+    quint16 port = 0;
+    QByteArray refusal;
+    int length = httpParseConnect(data, HTTP_HEADER_MAX, host, port, refusal);
+
+    if(length == 0) return false;
+    if(length < 0)
+    {
+        _refuse(socket, refusal);
+        return false;
+    }
+    socket->read(length);
+    _openTunnel(socket, host, port, true);
+    return true;
+}
+
+void SshSocksSrv::_openTunnel(QTcpSocket *socket, QString host, quint16 port, bool http)
+{
+    _endHandshake(socket);
+
+    SshTunnelOut *tunnel = new SshTunnelOut(_sshclient, socket, QString("%1_%2").arg(_identifier).arg(++_count), host, port);
+    connect(tunnel, SIGNAL(disconnected()), this, SLOT(connectionDisconnected()));
+    _connections.append(tunnel);
+
+    /* The reply goes out before any forwarded byte */
+    QByteArray success = (http)?(QByteArray("HTTP/1.1 200 Connection established\r\n\r\n")):(socksReply(0x00));
+    QByteArray failure = (http)?(QByteArray("HTTP/1.1 502 Bad Gateway\r\n\r\n")):(socksReply(0x04));
+    connect(tunnel, &SshTunnelOut::channelReady, socket, [socket, success](){
+        socket->write(success);
+    });
+    connect(tunnel, &SshTunnelOut::channelFailed, this, [this, socket, failure](){
+        _failed++;
+        socket->write(failure);
+    });
+    if(tunnel->hasChannel())
+    {
+        socket->write(success);
+    }
+}
+
+void SshSocksSrv::_refuse(QTcpSocket *socket, QByteArray reply)
+{
+    _endHandshake(socket);
+    if(!reply.isEmpty()) socket->write(reply);
+    if(socket->state() == QAbstractSocket::ConnectedState)
+    {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        socket->disconnectFromHost();
+    }
+    else
+    {
+        socket->deleteLater();
+    }
+}
+
+void SshSocksSrv::_endHandshake(QTcpSocket *socket)
+{
+    if(!_handshakes.contains(socket)) return;
+    delete _handshakes.take(socket).timer;
+    QObject::disconnect(socket, 0, this, 0);
+}
+
+void SshSocksSrv::connectionDisconnected()
+{
+    SshTunnelOut *tunnel = (SshTunnelOut *)QObject::sender();
+    if(tunnel == NULL)
+        return;
+    _bytesReceived += tunnel->bytesReceived();
+    _bytesSent     += tunnel->bytesSent();
+    _connections.removeAll(tunnel);
+    tunnel->deleteLater();
+}
+
+void SshSocksSrv::sshDataReceived()
+{
+    foreach (SshTunnelOut *tunnel, _connections) {
+        tunnel->sshDataReceived();
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef SSHSOCKSSRV_H
+#define SSHSOCKSSRV_H
+
+#include <QObject>
+#include <QMap>
+#include "sshchannel.h"
+#include <QTcpServer>
+
+class SshTunnelOut;
+class SshClient;
+class QTcpSocket;
+class QTimer;
+
+/*
+ * Dynamic port forwarding : a local SOCKS5 and HTTP CONNECT proxy. The
+ * protocol is told from the first byte. Each request opens a direct-tcpip
+ * channel to the host and port it names, then the connection is handed to
+ * a SshTunnelOut for the data.
+ */
+class SshSocksSrv : public SshChannel
+{
+    Q_OBJECT
+
+    struct Handshake {
+        QTimer *timer;
+        bool greeted;
+    };
+
+    QTcpServer              *_tcpserver;
+    QList<SshTunnelOut*>    _connections;
+    QMap<QTcpSocket*, Handshake> _handshakes;
+    SshClient               *_sshclient;
+    QString                 _identifier;
+    int                     _maxConnections;
+    int                     _count;
+    int                     _refused;
+    int                     _failed;
+    qint64                  _bytesReceived;
+    qint64                  _bytesSent;
+
+public:
+    explicit SshSocksSrv(SshClient * client, QString port_identifier, quint16 bind = 0);
+    ~SshSocksSrv();
+    quint16 localPort();
+    void sshDataReceived();
+
+    void setMaxConnections(int count);
+    int maxConnections() const;
+    int activeConnections() const;
+    int totalConnections() const;
+    int refusedConnections() const;
+    int failedConnections() const;
+    qint64 bytesReceived() const;
+    qint64 bytesSent() const;
+
+public slots:
+    void createConnection();
+    void connectionDisconnected();
+
+private:
+    void _handshake(QTcpSocket *socket);
+    bool _socks5(QTcpSocket *socket);
+    bool _httpConnect(QTcpSocket *socket);
+    void _openTunnel(QTcpSocket *socket, QString host, quint16 port, bool http);
+    void _refuse(QTcpSocket *socket, QByteArray reply);
+    void _endHandshake(QTcpSocket *socket);
+};
+
+#endif // SSHSOCKSSRV_H
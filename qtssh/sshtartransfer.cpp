@@ -0,0 +1,700 @@
+#include "sshtartransfer.h"
+#include "sshclient.h"
+#include "sshprocess.h"
+#include "sshchunkqueue.h"
+#include "sshutils.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QTimer>
+#include <QEventLoop>
+#include <QAtomicInteger>
+#include <QDebug>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define TAR_CHUNK_LEN (256 * 1024)
+#define TAR_META_MAX  (1024 * 1024)
+
+/* Extract the tar stream received from the channel below a local directory */
+class SshTarExtractor : public QThread
+{
+    struct DirAttr {
+        QString relative;
+        quint32 mode;
+        quint64 mtime;
+    };
+
+    QByteArray _header;
+    quint64 _remaining;
+    quint64 _padding;
+    int _zeroBlocks;
+    bool _ended;
+    char _metaType;
+    QByteArray _meta;
+    QByteArray _longName;
+    QByteArray _longLink;
+    QByteArray _paxPath;
+    QByteArray _paxLink;
+    QFile *_file;
+    QString _path;
+    QString _relative;
+    quint32 _mode;
+    quint64 _mtime;
+    QList<DirAttr> _dirs;
+
+public:
+    SshChunkQueue *queue;
+    QString root;
+    QAtomicInt files;
+    bool failed;
+    QString error;
+
+    SshTarExtractor(SshChunkQueue *q, QString r):
+        _remaining(0),
+        _padding(0),
+        _zeroBlocks(0),
+        _ended(false),
+        _metaType(0),
+        _file(NULL),
+        _mode(0),
+        _mtime(0),
+        queue(q),
+        root(r),
+        files(0),
+        failed(false)
+    {
+    }
+
+    ~SshTarExtractor()
+    {
+        delete _file;
+    }
+
+    void run()
+    {
+        QByteArray chunk;
+        while(!queue->atEnd())
+        {
+            if(!queue->pop(chunk, 100)) continue;
+            if(!feed(chunk.constData(), chunk.size()))
+            {
+                failed = true;
+                queue->abort();
+                break;
+            }
+        }
+        if(!failed && !_ended)
+        {
+            failed = true;
+            error = "truncated tar stream";
+        }
+        if(_file)
+        {
+            _file->close();
+        }
+        /* Directories last, deepest first, so their mtime is not moved by their content */
+        for(int i = _dirs.size() - 1; i >= 0; --i)
+        {
+            _setAttributes(_dirs[i].relative, _dirs[i].mode, _dirs[i].mtime);
+        }
+    }
+
+    bool feed(const char *data, qint64 len)
+    {
+        while(len > 0 && !_ended)
+        {
+            qint64 take;
+            if(_remaining == 0 && _padding == 0)
+            {
+                take = qMin<qint64>(TAR_BLOCK_LEN - _header.size(), len);
+                _header.append(data, int(take));
+                data += take;
+                len -= take;
+                if(_header.size() < TAR_BLOCK_LEN) return true;
+                bool ok = _beginEntry();
+                _header.clear();
+                if(!ok) return false;
+            }
+            else if(_remaining > 0)
+            {
+                take = qMin<qint64>(_remaining, len);
+                if(!_entryData(data, take)) return false;
+                _remaining -= take;
+                data += take;
+                len -= take;
+                if(_remaining == 0 && !_endEntry()) return false;
+            }
+            else
+            {
+                take = qMin<qint64>(_padding, len);
+                _padding -= take;
+                data += take;
+                len -= take;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool _beginEntry()
+    {
+        const char *h = _header.constData();
+
+        if(_header.count('\0') == TAR_BLOCK_LEN)
+        {
+            /* End of archive is marked by two zero blocks */
+            if(++_zeroBlocks >= 2) _ended = true;
+            return true;
+        }
+        _zeroBlocks = 0;
+        if(tarChecksum(h) != tarNumber(h + 148, 8))
+        {
+            error = "bad tar header checksum";
+            return false;
+        }
+
+        char type = h[156];
+        quint64 size = tarNumber(h + 124, 12);
+        _remaining = size;
+        _padding = (TAR_BLOCK_LEN - size % TAR_BLOCK_LEN) % TAR_BLOCK_LEN;
+
+        if(type == 'L' || type == 'K' || type == 'x' || type == 'g')
+        {
+            if(size > TAR_META_MAX)
+            {
+                error = "tar extended header too large";
+                return false;
+            }
+            _metaType = type;
+            _meta.clear();
+            return (size == 0)?(_endEntry()):(true);
+        }
+
+        QByteArray name = _longName;
+        if(name.isEmpty()) name = _paxPath;
+        if(name.isEmpty())
+        {
+            name = tarHeaderName(h);
+        }
+        QByteArray link = _longLink;
+        if(link.isEmpty()) link = _paxLink;
+        if(link.isEmpty()) link = tarString(h + 157, 100);
+        _longName.clear();
+        _longLink.clear();
+        _paxPath.clear();
+        _paxLink.clear();
+
+        QString relative;
+        if(!tarSafePath(QString::fromUtf8(name), relative))
+        {
+            qDebug() << "WARNING : SshTarTransfer : unsafe path skipped " << name;
+            relative.clear();
+        }
+        _mode  = quint32(tarNumber(h + 100, 8));
+        _mtime = tarNumber(h + 136, 12);
+
+        if(!relative.isEmpty())
+        {
+            _path = root + "/" + relative;
+            _relative = relative;
+            QByteArray native = QFile::encodeName(_path);
+            struct stat st;
+            switch(type)
+            {
+            case '5':
+            {
+                if(!_realDirs(relative, true, true))
+                {
+                    qDebug() << "WARNING : SshTarTransfer : path through a symlink skipped " << name;
+                    break;
+                }
+                DirAttr attr;
+                attr.relative = relative;
+                attr.mode     = _mode;
+                attr.mtime    = _mtime;
+                _dirs.append(attr);
+                break;
+            }
+            case '0':
+            case '\0':
+            case '7':
+            {
+                if(!_realDirs(relative, false, true))
+                {
+                    /* Data is skipped : no file open for the entry */
+                    qDebug() << "WARNING : SshTarTransfer : path through a symlink skipped " << name;
+                    break;
+                }
+                /* Replace what is there rather than write through it */
+                if(::lstat(native.constData(), &st) == 0 && !S_ISDIR(st.st_mode))
+                {
+                    ::unlink(native.constData());
+                }
+                int fd = ::open(native.constData(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+                _file = new QFile();
+                if(fd < 0 || !_file->open(fd, QIODevice::WriteOnly, QFileDevice::AutoCloseHandle))
+                {
+                    if(fd >= 0) ::close(fd);
+                    error = "can't open " + _path;
+                    return false;
+                }
+                break;
+            }
+            case '2':
+            {
+                if(!_realDirs(relative, false, true))
+                {
+                    qDebug() << "WARNING : SshTarTransfer : path through a symlink skipped " << name;
+                    break;
+                }
+                if(::lstat(native.constData(), &st) == 0 && !S_ISDIR(st.st_mode))
+                {
+                    ::unlink(native.constData());
+                }
+                ::symlink(link.constData(), native.constData());
+                break;
+            }
+            case '1':
+            {
+                QString target;
+                if(!tarSafePath(QString::fromUtf8(link), target) || target.isEmpty()
+                   || !_realDirs(relative, false, true) || !_realDirs(target, false, false))
+                {
+                    qDebug() << "WARNING : SshTarTransfer : unsafe hard link skipped " << name;
+                    break;
+                }
+                QByteArray targetNative = QFile::encodeName(root + "/" + target);
+                /* Only to a regular file of the root, never to what a link points to */
+                if(::lstat(targetNative.constData(), &st) != 0 || !S_ISREG(st.st_mode)) break;
+                if(::lstat(native.constData(), &st) == 0 && !S_ISDIR(st.st_mode))
+                {
+                    ::unlink(native.constData());
+                }
+                if(::link(targetNative.constData(), native.constData()) == 0) files.ref();
+                break;
+            }
+            default:
+                /* Devices, fifos... are not extracted */
+                break;
+            }
+        }
+        return (_remaining == 0)?(_endEntry()):(true);
+    }
+
+    /*
+     * lstat every directory from the root down to the entry (the entry
+     * itself too when withLast) : a symlink, whether it comes from the
+     * archive or was already in the destination, is never followed.
+     * Missing directories are created one level at a time.
+     */
+    bool _realDirs(const QString &relative, bool withLast, bool create) const
+    {
+        QStringList parts = relative.split("/");
+        if(!withLast) parts.removeLast();
+        QString path = root;
+        foreach(QString part, parts)
+        {
+            path += "/" + part;
+            QByteArray native = QFile::encodeName(path);
+            struct stat st;
+            if(::lstat(native.constData(), &st) != 0)
+            {
+                if(!create || ::mkdir(native.constData(), 0755) != 0 || ::lstat(native.constData(), &st) != 0)
+                {
+                    return false;
+                }
+            }
+            if(!S_ISDIR(st.st_mode)) return false;
+        }
+        return true;
+    }
+
+    bool _entryData(const char *data, qint64 len)
+    {
+        if(_metaType)
+        {
+            _meta.append(data, int(len));
+            return true;
+        }
+        if(_file && _file->write(data, len) != len)
+        {
+            error = "write error on " + _path;
+            return false;
+        }
+        return true;
+    }
+
+    bool _endEntry()
+    {
+        if(_metaType)
+        {
+            if(_metaType == 'L') _longName = tarString(_meta.constData(), _meta.size());
+            else if(_metaType == 'K') _longLink = tarString(_meta.constData(), _meta.size());
+            else if(_metaType == 'x') _parsePax();
+            _metaType = 0;
+            return true;
+        }
+        if(_file)
+        {
+            _file->close();
+            delete _file;
+            _file = NULL;
+            _setAttributes(_relative, _mode, _mtime);
+            files.ref();
+        }
+        return true;
+    }
+
+    void _parsePax()
+    {
+        /* Records are "<length> <key>=<value>\n" */
+        int pos = 0;
+        while(pos < _meta.size())
+        {
+            int space = _meta.indexOf(' ', pos);
+            if(space < 0) break;
+            int len = _meta.mid(pos, space - pos).toInt();
+            if(len <= 0 || pos + len > _meta.size()) break;
+            QByteArray record = _meta.mid(space + 1, pos + len - space - 2);
+            int eq = record.indexOf('=');
+            if(eq > 0)
+            {
+                QByteArray key = record.left(eq);
+                if(key == "path") _paxPath = record.mid(eq + 1);
+                else if(key == "linkpath") _paxLink = record.mid(eq + 1);
+            }
+            pos += len;
+        }
+    }
+
+    void _setAttributes(const QString &relative, quint32 mode, quint64 mtime)
+    {
+        /* Through a descriptor : chmod() and utime() would follow a link */
+        if(!_realDirs(relative, false, false)) return;
+        int fd = ::open(QFile::encodeName(root + "/" + relative).constData(), O_RDONLY | O_NOFOLLOW | O_NONBLOCK);
+        if(fd < 0) return;
+        struct timespec times[2];
+        times[0].tv_sec  = time_t(mtime);
+        times[0].tv_nsec = 0;
+        times[1] = times[0];
+        ::fchmod(fd, mode & 07777);
+        ::futimens(fd, times);
+        ::close(fd);
+    }
+};
+
+/* Build a tar stream from a local directory */
+class SshTarProducer : public QThread
+{
+    QByteArray _out;
+
+public:
+    SshChunkQueue *queue;
+    QString root;
+    QAtomicInt files;
+    bool failed;
+    QString error;
+
+    SshTarProducer(SshChunkQueue *q, QString r):
+        queue(q),
+        root(r),
+        files(0),
+        failed(false)
+    {
+    }
+
+    void run()
+    {
+        bool ok = _walk(root, QString());
+        if(ok)
+        {
+            _out.append(QByteArray(2 * TAR_BLOCK_LEN, 0));
+            ok = _flush(true);
+        }
+        if(ok)
+        {
+            queue->close();
+        }
+        else
+        {
+            failed = true;
+            queue->abort();
+        }
+    }
+
+private:
+    bool _walk(const QString &dir, const QString &relative)
+    {
+        QDir d(dir);
+        foreach(QFileInfo info, d.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System, QDir::Name))
+        {
+            QString rel = (relative.isEmpty())?(info.fileName()):(relative + "/" + info.fileName());
+            QByteArray native = QFile::encodeName(info.absoluteFilePath());
+            struct stat st;
+
+            if(::lstat(native.constData(), &st) != 0) continue;
+            if(S_ISLNK(st.st_mode))
+            {
+                char target[4096];
+                ssize_t len = ::readlink(native.constData(), target, sizeof(target));
+                if(len < 0) continue;
+                _entry(rel, '2', 0, st.st_mode, st.st_mtime, QByteArray(target, int(len)));
+            }
+            else if(S_ISDIR(st.st_mode))
+            {
+                _entry(rel + "/", '5', 0, st.st_mode, st.st_mtime, QByteArray());
+                if(!_flush(false) || !_walk(info.absoluteFilePath(), rel)) return false;
+            }
+            else if(S_ISREG(st.st_mode))
+            {
+                QFile file(info.absoluteFilePath());
+                if(!file.open(QIODevice::ReadOnly))
+                {
+                    qDebug() << "WARNING : SshTarTransfer : can't read " << info.absoluteFilePath();
+                    continue;
+                }
+                quint64 size = quint64(st.st_size);
+                quint64 done = 0;
+                _entry(rel, '0', size, st.st_mode, st.st_mtime, QByteArray());
+                while(done < size)
+                {
+                    /* The header announced the size : pad if the file shrank meanwhile */
+                    int chunk = int(qMin<quint64>(TAR_CHUNK_LEN, size - done));
+                    int old = _out.size();
+                    _out.resize(old + chunk);
+                    qint64 len = file.read(_out.data() + old, chunk);
+                    if(len <= 0)
+                    {
+                        memset(_out.data() + old, 0, size_t(chunk));
+                        len = chunk;
+                    }
+                    else
+                    {
+                        _out.resize(old + int(len));
+                    }
+                    done += quint64(len);
+                    if(!_flush(false)) return false;
+                }
+                _pad(size);
+                files.ref();
+            }
+            if(!_flush(false)) return false;
+        }
+        return true;
+    }
+
+    void _pad(quint64 size)
+    {
+        _out.append(QByteArray(int((TAR_BLOCK_LEN - size % TAR_BLOCK_LEN) % TAR_BLOCK_LEN), 0));
+    }
+
+    void _entry(const QString &name, char type, quint64 size, quint32 mode, quint64 mtime, const QByteArray &link)
+    {
+        QByteArray path = name.toUtf8();
+        QByteArray prefix;
+
+        if(link.size() > 100)
+        {
+            _header("././@LongLink", QByteArray(), 'K', quint64(link.size()) + 1, 0644, 0, QByteArray());
+            _out.append(link);
+            _out.append('\0');
+            _pad(quint64(link.size()) + 1);
+        }
+        if(path.size() > 100)
+        {
+            /* ustar prefix/name split, or a GNU long name entry */
+            int split = path.indexOf('/');
+            while(split >= 0 && path.size() - split - 1 > 100)
+            {
+                split = path.indexOf('/', split + 1);
+            }
+            if(split > 0 && split <= 155 && split < path.size() - 1)
+            {
+                prefix = path.left(split);
+                path = path.mid(split + 1);
+            }
+            else
+            {
+                _header("././@LongLink", QByteArray(), 'L', quint64(path.size()) + 1, 0644, 0, QByteArray());
+                _out.append(path);
+                _out.append('\0');
+                _pad(quint64(path.size()) + 1);
+                path.truncate(100);
+            }
+        }
+        _header(path, prefix, type, size, mode, mtime, link);
+    }
+
+    void _header(const QByteArray &name, const QByteArray &prefix, char type, quint64 size, quint32 mode, quint64 mtime, const QByteArray &link)
+    {
+        char h[TAR_BLOCK_LEN];
+        memset(h, 0, sizeof(h));
+        memcpy(h, name.constData(), size_t(qMin(100, name.size())));
+        tarSetNumber(h + 100, 8, mode & 07777);
+        tarSetNumber(h + 108, 8, 0);
+        tarSetNumber(h + 116, 8, 0);
+        tarSetNumber(h + 124, 12, size);
+        tarSetNumber(h + 136, 12, mtime);
+        h[156] = type;
+        memcpy(h + 157, link.constData(), size_t(qMin(100, link.size())));
+        memcpy(h + 257, "ustar", 6);
+        memcpy(h + 263, "00", 2);
+        memcpy(h + 345, prefix.constData(), size_t(qMin(155, prefix.size())));
+        snprintf(h + 148, 8, "%06o", tarChecksum(h));
+        h[155] = ' ';
+        _out.append(h, TAR_BLOCK_LEN);
+    }
+
+    bool _flush(bool force)
+    {
+        if(_out.size() >= TAR_CHUNK_LEN || (force && !_out.isEmpty()))
+        {
+            if(!queue->push(_out)) return false;
+            _out.clear();
+        }
+        return true;
+    }
+};
+
+SshTarTransfer::SshTarTransfer(SshClient *client):
+    QObject(client),
+    _client(client)
+{
+}
+
+QString SshTarTransfer::lastError() const
+{
+    return _lastError;
+}
+
+bool SshTarTransfer::get(QString remoteDir, QString localDir)
+{
+    _lastError.clear();
+    localDir = QDir(localDir).absolutePath();
+    if(!QDir().mkpath(localDir))
+    {
+        _lastError = "can't create " + localDir;
+        return false;
+    }
+
+    SshChunkQueue queue(64);
+    SshTarExtractor extractor(&queue, localDir);
+    extractor.start();
+
+    SshProcess *proc = new SshProcess(_client);
+    QEventLoop loop;
+    QTimer idle;
+    QByteArray buffer(TAR_CHUNK_LEN, 0);
+    qint64 wire = 0;
+    bool failed = false;
+
+    idle.setSingleShot(true);
+    idle.setInterval(2 * 60 * 1000);
+    QObject::connect(&idle, &QTimer::timeout, &loop, [&loop, &failed](){
+        failed = true;
+        loop.quit();
+    });
+    auto drain = [&](){
+        qint64 len;
+        while((len = proc->read(buffer.data(), buffer.size())) > 0)
+        {
+            if(!queue.push(QByteArray(buffer.constData(), int(len))))
+            {
+                loop.quit();
+                return;
+            }
+            wire += len;
+            idle.start();
+        }
+        emit progress(wire, extractor.files.load());
+        if(proc->isEOF()) loop.quit();
+    };
+    QObject::connect(proc, &SshProcess::readyRead, &loop, drain);
+    QObject::connect(proc, &SshProcess::readChannelFinished, &loop, drain);
+    proc->start(QString("tar -C %1 -cf - .").arg(shellQuote(remoteDir)));
+    idle.start();
+    loop.exec();
+    idle.stop();
+
+    queue.close();
+    extractor.wait();
+    if(failed || extractor.failed)
+    {
+        /* The rest of the remote stream is of no use : don't wait for it */
+        proc->cancel();
+    }
+    int status = (failed || extractor.failed)?(-1):(proc->exitStatus());
+    delete proc;
+
+    if(failed) _lastError = "timeout";
+    else if(extractor.failed) _lastError = extractor.error;
+    else if(status != 0) _lastError = QString("remote tar exited with status %1").arg(status);
+    if(!_lastError.isEmpty())
+    {
+        qDebug() << "ERROR : SshTarTransfer : get " << remoteDir << " failed : " << _lastError;
+        return false;
+    }
+    emit progress(wire, extractor.files.load());
+    return true;
+}
+
+bool SshTarTransfer::send(QString localDir, QString remoteDir)
+{
+    _lastError.clear();
+    localDir = QDir(localDir).absolutePath();
+    if(!QFileInfo(localDir).isDir())
+    {
+        _lastError = localDir + " is not a directory";
+        return false;
+    }
+
+    SshChunkQueue queue(16);
+    SshTarProducer producer(&queue, localDir);
+    SshProcess *proc = new SshProcess(_client);
+    proc->start(QString("mkdir -p %1 && tar -C %1 -x -o -f -").arg(shellQuote(remoteDir)));
+    producer.start();
+
+    QByteArray chunk;
+    qint64 wire = 0;
+    bool failed = !proc->waitForStarted();
+    if(failed) queue.abort();
+    while(!failed && !queue.atEnd())
+    {
+        if(!queue.pop(chunk, 100)) continue;
+        if(proc->write(chunk.constData(), chunk.size()) != chunk.size())
+        {
+            failed = true;
+            queue.abort();
+            break;
+        }
+        wire += chunk.size();
+        emit progress(wire, producer.files.load());
+        /* Keep the channel write queue short : the remote window paces the producer */
+        while(!failed && proc->bytesToWrite() > 4 * TAR_CHUNK_LEN)
+        {
+            failed = !proc->waitForBytesWritten(60000);
+        }
+        /* The producer may be blocked on the full queue */
+        if(failed) queue.abort();
+    }
+    producer.wait();
+    if(failed) proc->cancel();
+    else proc->closeWriteChannel();
+    int status = (failed)?(-1):(proc->exitStatus());
+    delete proc;
+
+    if(failed) _lastError = "channel write error";
+    else if(producer.failed) _lastError = (producer.error.isEmpty())?("local tar stream error"):(producer.error);
+    else if(status != 0) _lastError = QString("remote tar exited with status %1").arg(status);
+    if(!_lastError.isEmpty())
+    {
+        qDebug() << "ERROR : SshTarTransfer : send " << localDir << " failed : " << _lastError;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef SSHTARTRANSFER_H
+#define SSHTARTRANSFER_H
+
+#include <QObject>
+#include <QString>
+
+class SshClient;
+
+/*
+ * Transfer a whole directory tree as a single tar stream on an exec channel.
+ *
+ * get() runs "tar -c" on the host and extracts the stream locally on a worker
+ * thread as it arrives. send() builds the stream from the local tree on a
+ * producer thread and pipes it into "tar -x". The remote exit status is
+ * checked once the stream is complete.
+ */
+class SshTarTransfer : public QObject
+{
+    Q_OBJECT
+
+    SshClient *_client;
+    QString _lastError;
+
+public:
+    explicit SshTarTransfer(SshClient *client);
+
+    bool get(QString remoteDir, QString localDir);
+    bool send(QString localDir, QString remoteDir);
+    QString lastError() const;
+
+signals:
+    void progress(qint64 bytes, int files);
+};
+
+#endif // SSHTARTRANSFER_H
@@ -1,10 +1,12 @@
 #include "sshtunnelin.h"
 #include "sshclient.h"
 #include <QHostAddress>
+#include <QTcpSocket>
+#include <QLocalSocket>
 
-#include <QEventLoop>
-
-#define BUFFER_LEN (16384)
+#define BUFFER_LEN (64 * 1024)
+/* Stop reading the channel while the local socket has this much to send */
+#define TUNNEL_WRITE_WATERMARK (4 * BUFFER_LEN)
 
 SshTunnelIn::SshTunnelIn(SshClient *client, QString port_identifier, quint16 port, quint16 bind):
     SshChannel(client),
@@ -13,7 +15,7 @@ SshTunnelIn::SshTunnelIn(SshClient *client, QString port_identifier, quint16 por
     _currentState(TunnelListenTcpServer),
     _port(port),
     _name(port_identifier),
-    _tcpsocket(NULL)
+    _count(0)
 {
     if(bind == 0)
     {
@@ -28,128 +30,69 @@ SshTunnelIn::SshTunnelIn(SshClient *client, QString port_identifier, quint16 por
     sshDataReceived();
 }
 
-quint16 SshTunnelIn::localPort()
-{
-    return _localTcpPort;
-}
-
-void SshTunnelIn::onLocalSocketDisconnected()
+SshTunnelIn::SshTunnelIn(SshClient *client, QString port_identifier, quint16 port, QString localPath):
+    SshChannel(client),
+    _localTcpPort(0),
+    _localPath(localPath),
+    _sshListener(NULL),
+    _currentState(TunnelListenTcpServer),
+    _port(port),
+    _name(port_identifier),
+    _count(0)
 {
-    if (_tcpsocket != NULL)
-    {
-        if (sshChannel != NULL)
-        {
-            libssh2_channel_send_eof(sshChannel);
-        }
 #if defined(DEBUG_SSHCHANNEL)
-        qDebug() << "DEBUG : SshTunnelIn(" << _name << ") : tcp reverse socket disconnected !";
+    qDebug() << "DEBUG : SshTunnelIn(" << _name << ") : try reverse forwarding port " << _port << " to " << _localPath;
 #endif
-    }
-}
 
-void SshTunnelIn::onLocalSocketError(QAbstractSocket::SocketError error)
-{
-    if (error == QAbstractSocket::RemoteHostClosedError)
-    {
-        if (_tcpsocket != NULL)
-        {
-            _tcpsocket->disconnectFromHost();
-        }
-       return;
-    }
-    qDebug() << "ERROR : SshTunnelIn(" << _name << ") : redirection reverse socket error=" << error;
+    sshDataReceived();
 }
 
-void SshTunnelIn::onLocalSocketDataReceived()
+SshTunnelIn::~SshTunnelIn()
 {
-    QByteArray buffer(BUFFER_LEN, 0);
-    qint64 len = 0;
-    qint64 i   = 0;
-    int ret = 0;
-
-    if (_tcpsocket == NULL)
+    foreach(SshTunnelInConnection *connection, _connections)
     {
-        qDebug() << "WARNING : Channel " << _name << " : received data when busy";
-        return;
+        QObject::disconnect(connection, 0, this, 0);
+        connection->close("tunnel_closed");
     }
-
-    do
+    if(_sshListener)
     {
-        /* Read data from local socket */
-        len = _tcpsocket->read(buffer.data(), buffer.size());
-        if (-EAGAIN == len)
-        {
-            break;
-        }
-        else if (len < 0)
-        {
-            qDebug() << "ERROR : " << _name << " local failed to read (" << len << ")";
-            return;
-        }
-
-        qint64 written = 0;
-        while(written != len)
-        {
-            i = LIBSSH2_ERROR_EAGAIN;
-            while(i == LIBSSH2_ERROR_EAGAIN)
-            {
-                i = libssh2_channel_write(sshChannel, buffer.data() + written, len - written);
-                if (i == LIBSSH2_ERROR_EAGAIN)
-                {
-                    QTimer timer;
-                    QEventLoop loop;
-                    QObject::disconnect(_tcpsocket, &QTcpSocket::readyRead,    this, &SshTunnelIn::onLocalSocketDataReceived);
-                    QObject::connect(sshClient, &SshClient::sshDataReceived,    &loop, &QEventLoop::quit);
-                    connect(&timer,SIGNAL(timeout()),&loop,SLOT(quit()));
-                    timer.start(1000);
-                    loop.exec();
-                    QObject::disconnect(sshClient, &SshClient::sshDataReceived,    &loop, &QEventLoop::quit);
-                    QObject::connect(_tcpsocket, &QTcpSocket::readyRead,    this, &SshTunnelIn::onLocalSocketDataReceived);
-                }
-            }
+        libssh2_channel_forward_cancel(_sshListener);
+        _sshListener = NULL;
+    }
+}
 
-            if (i < 0)
-            {
-                qDebug() << "ERROR : " << _name << " remote failed to write (" << i << ")";
-                return;
-            }
+quint16 SshTunnelIn::localPort()
+{
+    return _localTcpPort;
+}
 
-            written += i;
-            ret = LIBSSH2_ERROR_EAGAIN;
-            while(ret == LIBSSH2_ERROR_EAGAIN)
-            {
-                ret = libssh2_channel_flush(sshChannel);
-                if (ret == LIBSSH2_ERROR_EAGAIN)
-                {
-                    QTimer timer;
-                    QEventLoop loop;
-                    QObject::disconnect(_tcpsocket, &QTcpSocket::readyRead,    this, &SshTunnelIn::onLocalSocketDataReceived);
-                    QObject::connect(sshClient, &SshClient::sshDataReceived,    &loop, &QEventLoop::quit);
-                    connect(&timer,SIGNAL(timeout()),&loop,SLOT(quit()));
-                    timer.start(1000);
-                    loop.exec();
-                    QObject::disconnect(sshClient, &SshClient::sshDataReceived,    &loop, &QEventLoop::quit);
-                    QObject::connect(_tcpsocket, &QTcpSocket::readyRead,    this, &SshTunnelIn::onLocalSocketDataReceived);
-                }
-            }
-        }
-        if(len > 0) emit data_tx(len);
-    }
-    while(_tcpsocket->bytesAvailable() > 0);
+int SshTunnelIn::connectionCount() const
+{
+    return _connections.size();
 }
 
 void SshTunnelIn::sshDataReceived()
 {
-    int bind = _localTcpPort;
+    int bind = 0;
     char * errmsg;
     int errlen;
     int err;
     int requestretry = 5;
+    LIBSSH2_CHANNEL *channel;
 
     switch(_currentState)
     {
     case TunnelListenTcpServer:
+        /* Not a channel open, but its reply must not be taken for another open's */
+        if (!sshClient->lockChannelOpen(this))
+        {
+            break;
+        }
         _sshListener = libssh2_channel_forward_listen_ex(sshClient->session(), "localhost", _port, &bind, 1);
+        if (_sshListener != NULL || libssh2_session_last_errno(sshClient->session()) != LIBSSH2_ERROR_EAGAIN)
+        {
+            sshClient->unlockChannelOpen(this);
+        }
         if (_sshListener != NULL)
         {
 #if defined(DEBUG_SSHCHANNEL)
@@ -193,52 +136,32 @@ void SshTunnelIn::sshDataReceived()
         break;
 
     case TunnelAcceptChannel:
-        sshChannel = libssh2_channel_forward_accept(_sshListener);
-        if (sshChannel == NULL)
+        /* Take every channel the listener has queued */
+        while((channel = libssh2_channel_forward_accept(_sshListener)) != NULL)
         {
-            err = libssh2_session_last_error(sshClient->session(), &errmsg, &errlen, 0);
-            if (err == LIBSSH2_ERROR_EAGAIN)
-            {
-                return;
-            }
-            else
-            {
-                this->_currentState = TunnelErrorNoRetry;
-                return;
-            }
-        }
-        else
-        {
-            _currentState = TunnelReadyRead;
-
-#if defined(DEBUG_SSHCHANNEL)
-            qDebug() << "DEBUG : SshTunnelIn(" << _name << ":" << _port << " @" << this <<") : onReverseChannelAccepted()";
-#endif
-
-            if (_tcpsocket == NULL)
-            {
-                _tcpsocket = new QTcpSocket(this);
-                _tcpsocket->setReadBufferSize(16384);
-                QObject::connect(_tcpsocket, &QTcpSocket::disconnected, this, &SshTunnelIn::onLocalSocketDisconnected);
-                QObject::connect(_tcpsocket, &QTcpSocket::readyRead,    this, &SshTunnelIn::onLocalSocketDataReceived);
-                QObject::connect(_tcpsocket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onLocalSocketError(QAbstractSocket::SocketError)));
-            }
-
-            if (_tcpsocket != NULL)
-            {
+            QString name = QString("%1_%2").arg(_name).arg(++_count);
 #if defined(DEBUG_SSHCHANNEL)
-                qDebug() << "DEBUG : SshTunnelIn(" << _name << ") : onReverseChannelAccepted( 4)" << _tcpsocket;
+            qDebug() << "DEBUG : SshTunnelIn(" << name << ":" << _port << " @" << this <<") : onReverseChannelAccepted()";
 #endif
-                if (_tcpsocket->state() == QAbstractSocket::UnconnectedState)
-                {
-                    _tcpsocket->connectToHost(QHostAddress("127.0.0.1"), _localTcpPort);
-                }
-            }
-            return;
+            SshTunnelInConnection *connection = (_localPath.isEmpty())
+                    ?(new SshTunnelInConnection(this, channel, _localTcpPort, name))
+                    :(new SshTunnelInConnection(this, channel, _localPath, name));
+            QObject::connect(connection, &SshTunnelInConnection::disconnected, this, &SshTunnelIn::connectionDisconnected);
+            QObject::connect(connection, &SshTunnelInConnection::data_rx,      this, &SshTunnelIn::data_rx);
+            QObject::connect(connection, &SshTunnelInConnection::data_tx,      this, &SshTunnelIn::data_tx);
+            _connections.append(connection);
+        }
+        err = libssh2_session_last_error(sshClient->session(), &errmsg, &errlen, 0);
+        if (err != LIBSSH2_ERROR_EAGAIN)
+        {
+            qDebug() << "ERROR : SshTunnelIn(" << _name << ") : accept failed (" << err << ") " << errmsg;
+            _currentState = TunnelErrorNoRetry;
         }
 
-    case TunnelReadyRead:
-        readSshData();
+        foreach(SshTunnelInConnection *connection, _connections)
+        {
+            connection->sshDataReceived();
+        }
         break;
 
     case TunnelErrorNoRetry:
@@ -249,81 +172,269 @@ void SshTunnelIn::sshDataReceived()
     }
 }
 
-void SshTunnelIn::readSshData()
+void SshTunnelIn::connectionDisconnected()
+{
+    SshTunnelInConnection *connection = qobject_cast<SshTunnelInConnection *>(QObject::sender());
+    if(connection == NULL)
+        return;
+    _connections.removeAll(connection);
+    connection->deleteLater();
+}
+
+SshTunnelInConnection::SshTunnelInConnection(QObject *parent, LIBSSH2_CHANNEL *channel, quint16 localPort, QString name):
+    QObject(parent),
+    _opened(true),
+    _socketClosed(false),
+    _name(name),
+    _sshChannel(channel),
+    _socket(NULL),
+    _dataSsh(BUFFER_LEN, 0),
+    _dataSocket(BUFFER_LEN, 0),
+    _socketOffset(0),
+    _socketPending(0)
 {
-    QByteArray buffer(BUFFER_LEN, 0);
-    ssize_t len,wr;
-    int i;
+    QTcpSocket *socket = new QTcpSocket(this);
+    _socket = socket;
+    socket->setReadBufferSize(BUFFER_LEN);
+    QObject::connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onLocalSocketError(QAbstractSocket::SocketError)));
+    _init();
+    socket->connectToHost(QHostAddress("127.0.0.1"), localPort);
+}
+
+SshTunnelInConnection::SshTunnelInConnection(QObject *parent, LIBSSH2_CHANNEL *channel, QString localPath, QString name):
+    QObject(parent),
+    _opened(true),
+    _socketClosed(false),
+    _name(name),
+    _sshChannel(channel),
+    _socket(NULL),
+    _dataSsh(BUFFER_LEN, 0),
+    _dataSocket(BUFFER_LEN, 0),
+    _socketOffset(0),
+    _socketPending(0)
+{
+    QLocalSocket *socket = new QLocalSocket(this);
+    _socket = socket;
+    socket->setReadBufferSize(BUFFER_LEN);
+    QObject::connect(socket, SIGNAL(error(QLocalSocket::LocalSocketError)), this, SLOT(onLocalUnixSocketError()));
+    _init();
+    socket->connectToServer(localPath);
+}
+
+void SshTunnelInConnection::_init()
+{
+    QObject::connect(_socket, SIGNAL(connected()),    this, SLOT(readSshData()));
+    QObject::connect(_socket, SIGNAL(disconnected()), this, SLOT(onLocalSocketDisconnected()));
+    QObject::connect(_socket, &QIODevice::readyRead,    this, &SshTunnelInConnection::onLocalSocketDataReceived);
+    QObject::connect(_socket, &QIODevice::bytesWritten, this, &SshTunnelInConnection::onLocalSocketDataWritten);
+}
 
-    if (sshChannel == NULL)
+bool SshTunnelInConnection::_connected() const
+{
+    QLocalSocket *local = qobject_cast<QLocalSocket *>(_socket);
+    if(local)
+    {
+        return local->state() == QLocalSocket::ConnectedState;
+    }
+    return static_cast<QTcpSocket *>(_socket)->state() == QAbstractSocket::ConnectedState;
+}
+
+SshTunnelInConnection::~SshTunnelInConnection()
+{
+    if(_sshChannel)
+    {
+        libssh2_channel_free(_sshChannel);
+        _sshChannel = NULL;
+    }
+}
+
+void SshTunnelInConnection::close(QString reason)
+{
+    if(!_opened) return;
+    _opened = false;
+    QObject::disconnect(_socket, 0, this, 0);
+    if(_connected())
+    {
+        /* Let the socket send what is still queued before going away */
+        _socket->setParent(NULL);
+        QObject::connect(_socket, SIGNAL(disconnected()), _socket, SLOT(deleteLater()));
+        if(qobject_cast<QLocalSocket *>(_socket))
+        {
+            static_cast<QLocalSocket *>(_socket)->disconnectFromServer();
+        }
+        else
+        {
+            static_cast<QTcpSocket *>(_socket)->disconnectFromHost();
+        }
+    }
+    if(_sshChannel)
+    {
+        libssh2_channel_free(_sshChannel);
+        _sshChannel = NULL;
+    }
+#if defined(DEBUG_SSHCHANNEL)
+    qDebug() << "DEBUG : SshTunnelIn(" << _name << ") : connection closed (" << reason << ")";
+#else
+    Q_UNUSED(reason);
+#endif
+    emit disconnected();
+}
+
+void SshTunnelInConnection::sshDataReceived()
+{
+    /* A window adjust may be what the socket side was waiting for */
+    onLocalSocketDataReceived();
+    readSshData();
+}
+
+void SshTunnelInConnection::onLocalSocketDisconnected()
+{
+#if defined(DEBUG_SSHCHANNEL)
+    qDebug() << "DEBUG : SshTunnelIn(" << _name << ") : tcp reverse socket disconnected !";
+#endif
+    /* Forward what the local service sent before leaving, then close */
+    _socketClosed = true;
+    onLocalSocketDataReceived();
+}
+
+void SshTunnelInConnection::onLocalSocketError(QAbstractSocket::SocketError error)
+{
+    if (error == QAbstractSocket::RemoteHostClosedError)
     {
-        qDebug() << "WARNING : Received data on non existing channel";
         return;
     }
+    qDebug() << "ERROR : SshTunnelIn(" << _name << ") : redirection reverse socket error=" << error;
+    if (!_connected())
+    {
+        /* Local service not reachable : refuse the remote client */
+        close("socket_error");
+    }
+}
 
-    do
+void SshTunnelInConnection::onLocalUnixSocketError()
+{
+    QLocalSocket *socket = static_cast<QLocalSocket *>(_socket);
+    if (socket->error() == QLocalSocket::PeerClosedError)
     {
-        /* Read data from SSH */
-        len = libssh2_channel_read(sshChannel, buffer.data(), buffer.size());
+        return;
+    }
+    qDebug() << "ERROR : SshTunnelIn(" << _name << ") : redirection reverse socket error=" << socket->errorString();
+    if (!_connected())
+    {
+        close("socket_error");
+    }
+}
 
-        if (LIBSSH2_ERROR_EAGAIN == len)
+bool SshTunnelInConnection::_writeChannel()
+{
+    while(_socketPending > 0)
+    {
+        ssize_t i = libssh2_channel_write(_sshChannel, _dataSocket.constData() + _socketOffset, size_t(_socketPending));
+        if (i == LIBSSH2_ERROR_EAGAIN || i == 0)
         {
-            continue;
+            /* Window full : resumed by sshDataReceived() on the window adjust */
+            return false;
         }
-        else if (len < 0)
+        if (i < 0)
         {
-            qDebug() << "ERROR : " << _name << " remote failed to read (" << len << ")";
-            return;
+            qDebug() << "ERROR : " << _name << " remote failed to write (" << i << ")";
+            close("channel_error");
+            return false;
         }
+        _socketOffset  += int(i);
+        _socketPending -= int(i);
+        emit data_tx(i);
+    }
+    return true;
+}
+
+void SshTunnelInConnection::onLocalSocketDataReceived()
+{
+    qint64 len = 0;
 
-        /* Write data into output local socket */
-        if (_tcpsocket == NULL)
+    if (!_opened)
+    {
+        return;
+    }
+
+    while(_opened && _writeChannel())
+    {
+        /* Leave in the socket what the remote window cannot take */
+        qint64 window = qint64(libssh2_channel_window_write(_sshChannel));
+        if (window <= 0)
         {
-            qDebug() << "ERROR : TCP NULL";
+            break;
+        }
+        len = _socket->read(_dataSocket.data(), qMin<qint64>(window, _dataSocket.size()));
+        if (len < 0)
+        {
+            qDebug() << "ERROR : " << _name << " local failed to read (" << len << ")";
+            close("socket_error");
             return;
         }
-
-        wr = 0;
-        while (wr < len)
+        if (len == 0)
         {
-            if (_tcpsocket->isValid() && _tcpsocket->state() == QAbstractSocket::ConnectedState)
-            {
-                i = _tcpsocket->write(buffer.data() + wr, len - wr);
-                if (i == -EAGAIN)
-                {
-                    continue;
-                }
-                if (i <= 0)
-                {
-                    qDebug() << "ERROR : " << _name << " local failed to write (" << i << ")";
-                    return;
-                }
-                wr += i;
-            }
-            else if (_tcpsocket->isValid() && _tcpsocket->state() == QAbstractSocket::UnconnectedState)
-            {
-                qDebug() << "WARNING : Channel " << _name << " : try to reconnect the local tcp socket";
-                _tcpsocket->connectToHost(QHostAddress("127.0.0.1"), _localTcpPort, QIODevice::ReadWrite);
-                _tcpsocket->waitForConnected(30000);
-            }
+            break;
         }
+        _socketOffset  = 0;
+        _socketPending = int(len);
+    }
 
-        emit data_rx(len);
+    if (_opened && _socketClosed && _socketPending == 0 && _socket->bytesAvailable() == 0)
+    {
+        libssh2_channel_send_eof(_sshChannel);
+        close("socket_disconnected");
+    }
+}
 
+void SshTunnelInConnection::onLocalSocketDataWritten()
+{
+    /* The local socket drained below the watermark : read the channel again */
+    if (_socket->bytesToWrite() < TUNNEL_WRITE_WATERMARK)
+    {
+        readSshData();
     }
-    while(len > 0);
+}
 
-    if (libssh2_channel_eof(sshChannel))
+void SshTunnelInConnection::readSshData()
+{
+    ssize_t len;
+    qint64 i;
+
+    if (!_opened || _socketClosed || !_connected())
     {
-#if defined(DEBUG_SSHCHANNEL)
-        qDebug() << "DEBUG : Disconnect channel";
-#endif
-        _currentState = TunnelAcceptChannel;
-        if(_tcpsocket)
+        /* The data waits in the channel, connected() resumes */
+        return;
+    }
+
+    while(_socket->bytesToWrite() < TUNNEL_WRITE_WATERMARK)
+    {
+        /* Read data from SSH */
+        len = libssh2_channel_read(_sshChannel, _dataSsh.data(), size_t(_dataSsh.size()));
+        if (len == LIBSSH2_ERROR_EAGAIN || len == 0)
+        {
+            break;
+        }
+        else if (len < 0)
+        {
+            qDebug() << "ERROR : " << _name << " remote failed to read (" << len << ")";
+            close("channel_error");
+            return;
+        }
+
+        /* Write data into output local socket, QTcpSocket queues all of it */
+        i = _socket->write(_dataSsh.constData(), len);
+        if (i != len)
         {
-            _tcpsocket->disconnectFromHost();
-            _tcpsocket->close();
+            qDebug() << "ERROR : " << _name << " local failed to write (" << i << ")";
+            close("socket_error");
+            return;
         }
+        emit data_rx(len);
     }
-}
 
+    if (libssh2_channel_eof(_sshChannel))
+    {
+        close("channel_eof");
+    }
+}
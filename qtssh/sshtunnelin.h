@@ -3,8 +3,16 @@
 
 #include "sshchannel.h"
 #include <QAbstractSocket>
-class QTcpSocket;
+#include <QList>
+class QIODevice;
+class SshTunnelInConnection;
 
+/*
+ * Remote port forward. Every channel accepted on the remote listener gets
+ * its own SshTunnelInConnection and local socket, so any number of remote
+ * clients may use the forward at the same time. The local end is a tcp
+ * port or, given a path, a local unix socket.
+ */
 class SshTunnelIn : public SshChannel
 {
     Q_OBJECT
@@ -13,28 +21,73 @@ class SshTunnelIn : public SshChannel
         TunnelError = 0,
         TunnelListenTcpServer = 1,
         TunnelAcceptChannel = 2,
-        TunnelReadyRead = 3,
         TunnelErrorNoRetry = 4
     };
 private:
     quint16 _localTcpPort;
+    QString _localPath;
     LIBSSH2_LISTENER *_sshListener;
     SshTunnelInState _currentState;
     quint16 _port;
     QString _name;
-    QTcpSocket *_tcpsocket;
+    QList<SshTunnelInConnection*> _connections;
+    int _count;
 
 public:
     explicit SshTunnelIn(SshClient * client, QString port_identifier, quint16 port, quint16 bind);
+    explicit SshTunnelIn(SshClient * client, QString port_identifier, quint16 port, QString localPath);
+    virtual ~SshTunnelIn();
     quint16 localPort();
+    int connectionCount() const;
 
 private slots:
+    virtual void sshDataReceived();
+    void connectionDisconnected();
+};
+
+/*
+ * One accepted channel paired with a connection to the local port or unix
+ * socket. Same flow control as SshTunnelOut : one bounded buffer per
+ * direction.
+ */
+class SshTunnelInConnection : public QObject
+{
+    Q_OBJECT
+
+    bool _opened;
+    bool _socketClosed;
+    QString _name;
+    LIBSSH2_CHANNEL *_sshChannel;
+    QIODevice *_socket;
+    QByteArray _dataSsh;
+    QByteArray _dataSocket;
+    int _socketOffset;
+    int _socketPending;
+
+public:
+    explicit SshTunnelInConnection(QObject *parent, LIBSSH2_CHANNEL *channel, quint16 localPort, QString name);
+    explicit SshTunnelInConnection(QObject *parent, LIBSSH2_CHANNEL *channel, QString localPath, QString name);
+    virtual ~SshTunnelInConnection();
+    void sshDataReceived();
+    void close(QString reason);
+
+signals:
+    void disconnected();
+    void data_rx(qint64 cnt);
+    void data_tx(qint64 cnt);
+
+private slots:
+    void onLocalSocketDataReceived();
+    void onLocalSocketDataWritten();
     void onLocalSocketDisconnected();
     void onLocalSocketError(QAbstractSocket::SocketError error);
-    void onLocalSocketDataReceived();
-
-    virtual void sshDataReceived();
+    void onLocalUnixSocketError();
     void readSshData();
+
+private:
+    void _init();
+    bool _connected() const;
+    bool _writeChannel();
 };
 
 #endif // SSHTUNNELIN_H
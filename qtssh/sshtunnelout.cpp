@@ -2,48 +2,224 @@
 #include "sshclient.h"
 #include <QTcpServer>
 #include <QTcpSocket>
-#include <QEventLoop>
+#include <QLocalSocket>
+#include <QFile>
 
-SshTunnelOut::SshTunnelOut(SshClient *client, QTcpSocket *tcpSocket, QString port_identifier, quint16 port):
+#define TUNNEL_BUFFER_SIZE (64 * 1024)
+/* Stop reading the channel while the local socket has this much to send */
+#define TUNNEL_WRITE_WATERMARK (4 * TUNNEL_BUFFER_SIZE)
+/* direct-streamlocal (remote unix socket) appeared in libssh2 1.10 */
+#if LIBSSH2_VERSION_NUM >= 0x010a00
+#define TUNNEL_STREAMLOCAL 1
+#else
+#define TUNNEL_STREAMLOCAL 0
+#endif
+
+static void socketSetReadBufferSize(QIODevice *socket, qint64 size)
+{
+    QAbstractSocket *tcp = qobject_cast<QAbstractSocket *>(socket);
+    QLocalSocket *local = qobject_cast<QLocalSocket *>(socket);
+    if(tcp) tcp->setReadBufferSize(size);
+    if(local) local->setReadBufferSize(size);
+}
+
+static bool socketConnected(QIODevice *socket)
+{
+    QAbstractSocket *tcp = qobject_cast<QAbstractSocket *>(socket);
+    QLocalSocket *local = qobject_cast<QLocalSocket *>(socket);
+    if(tcp) return tcp->state() == QAbstractSocket::ConnectedState;
+    return local && local->state() == QLocalSocket::ConnectedState;
+}
+
+static void socketDisconnect(QIODevice *socket)
+{
+    QAbstractSocket *tcp = qobject_cast<QAbstractSocket *>(socket);
+    QLocalSocket *local = qobject_cast<QLocalSocket *>(socket);
+    if(tcp) tcp->disconnectFromHost();
+    if(local) local->disconnectFromServer();
+}
+
+SshTunnelOut::SshTunnelOut(SshClient *client, QIODevice *socket, QString port_identifier, quint16 port, LIBSSH2_CHANNEL *channel):
     QObject(client),
     _opened(true),
+    _socketClosed(false),
+    _openWaiting(false),
+    _host("127.0.0.1"),
     _port(port),
     _name(port_identifier),
-    _tcpsocket(tcpSocket),
+    _socket(socket),
+    _client(client),
+    _sshChannel(channel),
+    _dataSsh(TUNNEL_BUFFER_SIZE, 0),
+    _dataSocket(TUNNEL_BUFFER_SIZE, 0),
+    _socketOffset(0),
+    _socketPending(0),
+    _bytesReceived(0),
+    _bytesSent(0)
+{
+    _init();
+}
+
+SshTunnelOut::SshTunnelOut(SshClient *client, QIODevice *socket, QString port_identifier, QString host, quint16 port):
+    QObject(client),
+    _opened(true),
+    _socketClosed(false),
+    _openWaiting(false),
+    _host(host.toUtf8()),
+    _port(port),
+    _name(port_identifier),
+    _socket(socket),
     _client(client),
     _sshChannel(NULL),
-    _dataSsh(16384, 0),
-    _dataSocket(16384, 0)
+    _dataSsh(TUNNEL_BUFFER_SIZE, 0),
+    _dataSocket(TUNNEL_BUFFER_SIZE, 0),
+    _socketOffset(0),
+    _socketPending(0),
+    _bytesReceived(0),
+    _bytesSent(0)
+{
+    _init();
+}
+
+SshTunnelOut::SshTunnelOut(SshClient *client, QIODevice *socket, QString port_identifier, QString remotePath):
+    QObject(client),
+    _opened(true),
+    _socketClosed(false),
+    _openWaiting(false),
+    _host("127.0.0.1"),
+    _port(0),
+    _remotePath(QFile::encodeName(remotePath)),
+    _name(port_identifier),
+    _socket(socket),
+    _client(client),
+    _sshChannel(NULL),
+    _dataSsh(TUNNEL_BUFFER_SIZE, 0),
+    _dataSocket(TUNNEL_BUFFER_SIZE, 0),
+    _socketOffset(0),
+    _socketPending(0),
+    _bytesReceived(0),
+    _bytesSent(0)
+{
+    _init();
+}
+
+void SshTunnelOut::_init()
 {
-    _sshChannel = libssh2_channel_direct_tcpip(_client->session(), "127.0.0.1", _port);
-    if(_sshChannel) emit channelReady();
-    if(_tcpsocket)
+    /* A channel taken from a pool is already open */
+    if(_sshChannel == NULL)
     {
-        QObject::connect(_tcpsocket, &QTcpSocket::readyRead,      this, &SshTunnelOut::tcpDataReceived);
-        QObject::connect(_tcpsocket, &QTcpSocket::disconnected,   this, &SshTunnelOut::tcpDisconnected);
-        QObject::connect(_tcpsocket, SIGNAL(error(QAbstractSocket::SocketError)),   this, SLOT(displayError(QAbstractSocket::SocketError)));
+        _sshChannel = _openChannel();
+    }
+    if(_socket)
+    {
+        /* Unread data stays in the kernel : the peer is throttled by TCP */
+        socketSetReadBufferSize(_socket, TUNNEL_BUFFER_SIZE);
+        QObject::connect(_socket, &QIODevice::readyRead,      this, &SshTunnelOut::tcpDataReceived);
+        QObject::connect(_socket, &QIODevice::bytesWritten,   this, &SshTunnelOut::tcpDataWritten);
+        QObject::connect(_socket, SIGNAL(disconnected()),     this, SLOT(tcpDisconnected()));
+        if(qobject_cast<QLocalSocket *>(_socket))
+        {
+            QObject::connect(_socket, SIGNAL(error(QLocalSocket::LocalSocketError)), this, SLOT(localSocketError()));
+        }
+        else
+        {
+            QObject::connect(_socket, SIGNAL(error(QAbstractSocket::SocketError)),   this, SLOT(displayError(QAbstractSocket::SocketError)));
+        }
     }
 
 #if defined(DEBUG_SSHCLIENT)
-    qDebug() << "DEBUG : SshTunnelOut : Connection" << port_identifier << "created";
+    qDebug() << "DEBUG : SshTunnelOut : Connection" << _name << "created to" << ((_remotePath.isEmpty())?(_host):(_remotePath)) << ":" << _port;
+#endif
+}
+
+LIBSSH2_CHANNEL *SshTunnelOut::_openChannel()
+{
+    LIBSSH2_SESSION *session = _client->session();
+    QByteArray host = _host;
+    QByteArray path = _remotePath;
+    quint16 port = _port;
+    LIBSSH2_CHANNEL *channel = NULL;
+
+#if !TUNNEL_STREAMLOCAL
+    if(!path.isEmpty())
+    {
+        /* Reported as a refused channel by sshDataReceived() */
+        qDebug() << "ERROR : SshTunnelOut(" << _name << ") : remote unix sockets need libssh2 1.10";
+        return NULL;
+    }
+#endif
+    /* Only what the open needs is captured : the tunnel may be gone when it completes */
+    _openWaiting = !_client->lockChannelOpen(this, [session, host, path, port]() {
+            LIBSSH2_CHANNEL *dropped;
+#if TUNNEL_STREAMLOCAL
+            if(!path.isEmpty()) dropped = libssh2_channel_direct_streamlocal_ex(session, path.constData(), host.constData(), 0);
+            else
+#endif
+            dropped = libssh2_channel_direct_tcpip(session, host.constData(), port);
+            if(dropped) libssh2_channel_free(dropped);
+            return dropped != NULL || libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN;
+        });
+    if(_openWaiting)
+    {
+        /* Another open is in flight on the session */
+        return NULL;
+    }
+#if TUNNEL_STREAMLOCAL
+    if(!path.isEmpty()) channel = libssh2_channel_direct_streamlocal_ex(session, path.constData(), host.constData(), 0);
+    else
 #endif
+    channel = libssh2_channel_direct_tcpip(session, host.constData(), port);
+    if(channel != NULL || libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN)
+    {
+        _client->unlockChannelOpen(this);
+    }
+    return channel;
+}
+
+bool SshTunnelOut::hasChannel() const
+{
+    return _sshChannel != NULL;
+}
+
+qint64 SshTunnelOut::bytesReceived() const
+{
+    return _bytesReceived;
+}
+
+qint64 SshTunnelOut::bytesSent() const
+{
+    return _bytesSent;
 }
 
 void SshTunnelOut::close(QString reason)
 {
     if(!_opened) return;
     _opened = false;
-    if(_tcpsocket)
+    if(_socket)
     {
-        QObject::disconnect(_tcpsocket, &QTcpSocket::readyRead, this,  &SshTunnelOut::tcpDataReceived);
-        QObject::disconnect(_tcpsocket, SIGNAL(disconnected()),                        this, SLOT(tcpDisconnected()));
-        QObject::disconnect(_tcpsocket, SIGNAL(error(QAbstractSocket::SocketError)),   this, SLOT(displayError(QAbstractSocket::SocketError)));
-        if(_tcpsocket->state() == QAbstractSocket::ConnectedState)
-            _tcpsocket->disconnectFromHost();
-        _tcpsocket->deleteLater();
-        _tcpsocket = NULL;
+        QObject::disconnect(_socket, 0, this, 0);
+        if(socketConnected(_socket))
+        {
+            /* Let the socket send what is still queued before going away */
+            QObject::connect(_socket, SIGNAL(disconnected()), _socket, SLOT(deleteLater()));
+            socketDisconnect(_socket);
+        }
+        else
+        {
+            _socket->deleteLater();
+        }
+        _socket = NULL;
+    }
+    if(_sshChannel)
+    {
+        libssh2_channel_free(_sshChannel);
+        _sshChannel = NULL;
+    }
+    else
+    {
+        /* Leave the open queue, or let the client finish and free our half-done open */
+        _client->abandonChannelOpen(this);
     }
-    if(_sshChannel) libssh2_channel_free(_sshChannel);
 #if defined(DEBUG_SSHCLIENT)
     qDebug() << "DEBUG : Connection" << _name << "closed (" << reason << ")";
 #else
@@ -54,138 +230,169 @@ void SshTunnelOut::close(QString reason)
 
 void SshTunnelOut::sshDataReceived()
 {
-    char *buf = _dataSsh.data();
-    ssize_t len = 0,wr = 0;
-    int i;
+    if(!_opened) return;
 
-    while (_sshChannel == NULL)
+    if (_sshChannel == NULL)
     {
-        _sshChannel = libssh2_channel_direct_tcpip(_client->session(), "127.0.0.1", _port);
+        _sshChannel = _openChannel();
         if (_sshChannel == NULL)
         {
+            if(_openWaiting) return;
             char *errmsg;
             int errlen;
             int err = libssh2_session_last_error(_client->session(), &errmsg, &errlen, 0);
 
-            if(err == LIBSSH2_ERROR_EAGAIN)
+            if(err != LIBSSH2_ERROR_EAGAIN || (!_remotePath.isEmpty() && !TUNNEL_STREAMLOCAL))
             {
-                return;
+                /* Refused by the server (destination unreachable, forwarding disabled) */
+                qDebug() << "ERROR : SshTunnelOut(" << _name << ") : direct_tcpip failed :" << err << QString::fromLocal8Bit(errmsg, errlen);
+                emit channelFailed();
+                close("channel_refused");
             }
-            qDebug() << "ERROR : SshTunnelOut(" << _name << ") : direct_tcpip failed :" << err << QString::fromLocal8Bit(errmsg, errlen);
-            if(_sshChannel) emit channelReady();
+            return;
         }
+        emit channelReady();
     }
 
-    do
+    /* A window adjust may be what we were waiting for */
+    tcpDataReceived();
+    _readChannel();
+}
+
+void SshTunnelOut::_readChannel()
+{
+    char *buf = _dataSsh.data();
+    ssize_t len = 0;
+    qint64 i;
+
+    if(!_opened || _sshChannel == NULL || _socket == NULL || _socketClosed) return;
+
+    while(_socket->bytesToWrite() < TUNNEL_WRITE_WATERMARK)
     {
         /* Read data from SSH */
-        len = libssh2_channel_read(_sshChannel, buf, sizeof(buf));
-        if (LIBSSH2_ERROR_EAGAIN == len)
+        len = libssh2_channel_read(_sshChannel, buf, size_t(_dataSsh.size()));
+        if (len == LIBSSH2_ERROR_EAGAIN || len == 0)
         {
             break;
         }
         else if (len < 0)
         {
             qDebug() << "ERROR : " << _name << " remote failed to read (" << len << ")";
+            close("channel_error");
             return;
         }
 
-        /* Write data into output local socket */
-        wr = 0;
-        if(_tcpsocket != NULL)
-        {
-            while (wr < len)
-            {
-                i = _tcpsocket->write(buf + wr, len - wr);
-                if (i <= 0)
-                {
-                    qDebug() << "ERROR : " << _name << " local failed to write (" << i << ")";
-                    return;
-                }
-                wr += i;
-            }
-        }
-        else
+        /* Write data into output local socket, QTcpSocket queues all of it */
+        i = _socket->write(buf, len);
+        if (i != len)
         {
-            if(_opened) qDebug() << "ERROR : Data loose";
+            qDebug() << "ERROR : " << _name << " local failed to write (" << i << ")";
+            close("socket_error");
+            return;
         }
+        _bytesReceived += len;
+    }
 
+    /* Not eof while data is left in the channel : the watermark stopped us */
+    if (libssh2_channel_eof(_sshChannel))
+    {
+        close("channel_eof");
+    }
+}
 
-        if (libssh2_channel_eof(_sshChannel) && _opened)
+bool SshTunnelOut::_writeChannel()
+{
+    while(_socketPending > 0)
+    {
+        ssize_t i = libssh2_channel_write(_sshChannel, _dataSocket.constData() + _socketOffset, size_t(_socketPending));
+        if (i == LIBSSH2_ERROR_EAGAIN)
         {
-            close("channel_eof");
+            /* Window full : sshDataReceived() resumes on the window adjust */
+            return false;
         }
+        if (i < 0)
+        {
+            qDebug() << "ERROR : " << _name << " remote failed to write (" << i << ")";
+            close("channel_error");
+            return false;
+        }
+        if (i == 0)
+        {
+            return false;
+        }
+        _socketOffset  += int(i);
+        _socketPending -= int(i);
+        _bytesSent     += i;
     }
-    while(len > 0);
+    return true;
 }
 
 void SshTunnelOut::tcpDataReceived()
 {
-    char *buf = _dataSocket.data();
     qint64 len = 0;
-    ssize_t wr = 0;
-    ssize_t i = 0;
-    unsigned retry = 100;
-
-    while(!_sshChannel && retry--)
-    {
-        QEventLoop loop;
-        QTimer timer;
-        timer.start(100);
-        connect(&timer,SIGNAL(timeout()),&loop,SLOT(quit()));
-        connect(this,SIGNAL(channelReady()),&loop,SLOT(quit()));
-        loop.exec();
-    }
-    if(!_tcpsocket) return;
 
-    if (_tcpsocket == NULL || _sshChannel == NULL)
+    if (_socket == NULL || _sshChannel == NULL)
     {
-        qDebug() << "ERROR : SshTunnelOut(" << _name << ") : received TCP data but not seems to be a valid Tcp socket or channel not ready";
+        /* The data waits in the socket until the channel is opened */
         return;
     }
 
-    do
+    while(_opened && _writeChannel())
     {
-        /* Read data from local socket */
-        len = _tcpsocket->read(buf, sizeof(buf));
-        if (-EAGAIN == len)
+        /* Never take more from the socket than the remote window accepts */
+        qint64 window = qint64(libssh2_channel_window_write(_sshChannel));
+        if (window <= 0)
         {
             break;
         }
-        else if (len < 0)
+        len = _socket->read(_dataSocket.data(), qMin<qint64>(window, _dataSocket.size()));
+        if (len < 0)
         {
             qDebug() << "ERROR : " << _name << " local failed to read (" << len << ")";
+            close("socket_error");
             return;
         }
-
-        do
+        if (len == 0)
         {
-            i = libssh2_channel_write(_sshChannel, buf, len);
-            if (i == LIBSSH2_ERROR_EAGAIN)
-            {
-                QTimer timer;
-                QEventLoop loop;
-                connect(&timer,SIGNAL(timeout()),&loop,SLOT(quit()));
-                timer.start(1000);
-                loop.exec();
-            }
-            else
-            {
-                if (i < 0)
-                {
-                    qDebug() << "ERROR : " << _name << " remote failed to write (" << i << ")";
-                    return;
-                }
-                wr += i;
-            }
-        } while(i > 0 && wr < len);
+            break;
+        }
+        _socketOffset  = 0;
+        _socketPending = int(len);
+    }
+
+    if (_opened && _socketClosed && _socketPending == 0 && _socket->bytesAvailable() == 0)
+    {
+        close("socket_disconnected");
+    }
+}
+
+void SshTunnelOut::tcpDataWritten()
+{
+    /* The local socket drained below the watermark : read the channel again */
+    if (_socket && _socket->bytesToWrite() < TUNNEL_WRITE_WATERMARK)
+    {
+        _readChannel();
     }
-    while(len > 0);
 }
 
 void SshTunnelOut::tcpDisconnected()
 {
-    close("socket_diconnected");
+    /* Forward what the peer sent before leaving, then close */
+    _socketClosed = true;
+    tcpDataReceived();
+    if (_opened && _sshChannel == NULL)
+    {
+        close("socket_disconnected");
+    }
+}
+
+void SshTunnelOut::localSocketError()
+{
+    QLocalSocket *local = qobject_cast<QLocalSocket *>(_socket);
+    if(local && local->error() != QLocalSocket::PeerClosedError)
+    {
+        qDebug() << "ERROR : SshTunnelOut(" << _name << ") : redirection socket error=" << local->errorString();
+    }
 }
 
 void SshTunnelOut::displayError(QAbstractSocket::SocketError error)
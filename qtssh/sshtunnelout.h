@@ -6,37 +6,68 @@
 
 class QTcpServer;
 class QTcpSocket;
+class QIODevice;
 class SshClient;
 
 
+/*
+ * One local connection (QTcpSocket or QLocalSocket) forwarded through a
+ * direct-tcpip channel, or a direct-streamlocal one to a remote unix
+ * socket. Each direction holds at most one buffer : the socket is not read
+ * while the remote window is closed, the channel is not read while the
+ * socket has more than a watermark to send. Both resume on the matching
+ * signal, no call ever waits. Channel opens go through the client open
+ * lock : a tunnel waits its turn before asking the server.
+ */
 class SshTunnelOut: public QObject
 {
     Q_OBJECT
 
 private:
     bool _opened;
+    bool _socketClosed;
+    bool _openWaiting;
+    QByteArray _host;
     quint16 _port;
+    QByteArray _remotePath;
     QString _name;
-    QTcpSocket *_tcpsocket;
+    QIODevice *_socket;
     SshClient *_client;
     LIBSSH2_CHANNEL *_sshChannel;
     QByteArray _dataSsh;
     QByteArray _dataSocket;
+    int _socketOffset;
+    int _socketPending;
+    qint64 _bytesReceived;
+    qint64 _bytesSent;
 
 public:
-    explicit SshTunnelOut(SshClient *client, QTcpSocket *tcpSocket, QString port_identifier, quint16 port);
+    explicit SshTunnelOut(SshClient *client, QIODevice *socket, QString port_identifier, quint16 port, LIBSSH2_CHANNEL *channel = NULL);
+    explicit SshTunnelOut(SshClient *client, QIODevice *socket, QString port_identifier, QString host, quint16 port);
+    explicit SshTunnelOut(SshClient *client, QIODevice *socket, QString port_identifier, QString remotePath);
+    bool hasChannel() const;
+    qint64 bytesReceived() const;
+    qint64 bytesSent() const;
     void close(QString reason);
     void sshDataReceived();
 
 private slots:
     void displayError(QAbstractSocket::SocketError error);
     void tcpDataReceived();
+    void tcpDataWritten();
     void tcpDisconnected();
+    void localSocketError();
 
+private:
+    void _init();
+    LIBSSH2_CHANNEL *_openChannel();
+    bool _writeChannel();
+    void _readChannel();
 
 signals:
     void disconnected();
     void channelReady();
+    void channelFailed();
     
 };
 
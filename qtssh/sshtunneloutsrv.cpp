@@ -1,12 +1,19 @@
 #include "sshtunneloutsrv.h"
 #include "sshtunnelout.h"
 #include "sshclient.h"
+#include <QTimer>
 
 SshTunnelOutSrv::SshTunnelOutSrv(SshClient *client, QString port_identifier, quint16 port):
     SshChannel(client),
     _sshclient(client),
     _identifier(port_identifier),
-    _port(port)
+    _port(port),
+    _count(0),
+    _channelPoolSize(0),
+    _channelPoolRefused(false),
+    _channelPoolOpening(false),
+    _poolHits(0),
+    _poolMisses(0)
 {
     _tcpserver = new QTcpServer(this);
     _tcpserver->listen(QHostAddress("127.0.0.1"), 0);
@@ -18,21 +25,23 @@ SshTunnelOutSrv::~SshTunnelOutSrv()
     foreach (SshTunnelOut *tunnel, _connections) {
         tunnel->deleteLater();
     }
+    foreach (LIBSSH2_CHANNEL *channel, _channelPool) {
+        libssh2_channel_close(channel);
+        libssh2_channel_free(channel);
+    }
     _tcpserver->close();
     _tcpserver->deleteLater();
 }
 
 void SshTunnelOutSrv::createConnection()
 {
-    static int count = 0;
-
     if(!_sshclient->channelReady())
     {
         qDebug() << "WARNING : SshTunnelOut cannot open channel before connected()";
         return;
     }
 
-    SshTunnelOut *tunnel = new SshTunnelOut(_sshclient, _tcpserver->nextPendingConnection(), QString("%1_%2").arg(_identifier).arg(++count), _port);
+    SshTunnelOut *tunnel = new SshTunnelOut(_sshclient, _tcpserver->nextPendingConnection(), QString("%1_%2").arg(_identifier).arg(++_count), _port, _takeChannel());
     connect(tunnel,SIGNAL(disconnected()), this, SLOT(connectionDisconnected()));
     _connections.append(tunnel);
 }
@@ -56,4 +65,106 @@ void SshTunnelOutSrv::sshDataReceived()
     foreach (SshTunnelOut *tunnel, _connections) {
         tunnel->sshDataReceived();
     }
+    _fillChannelPool();
+}
+
+void SshTunnelOutSrv::setChannelPoolSize(int count)
+{
+    _channelPoolSize = qMax(0, count);
+    while(_channelPool.size() > _channelPoolSize)
+    {
+        LIBSSH2_CHANNEL *channel = _channelPool.takeLast();
+        libssh2_channel_close(channel);
+        libssh2_channel_free(channel);
+    }
+    _channelPoolRefused = false;
+    _fillChannelPool();
+}
+
+int SshTunnelOutSrv::channelPoolSize() const
+{
+    return _channelPoolSize;
+}
+
+quint64 SshTunnelOutSrv::channelPoolHits() const
+{
+    return _poolHits;
+}
+
+quint64 SshTunnelOutSrv::channelPoolMisses() const
+{
+    return _poolMisses;
+}
+
+LIBSSH2_CHANNEL *SshTunnelOutSrv::_takeChannel()
+{
+    if(_channelPoolSize == 0) return NULL;
+
+    while(!_channelPool.isEmpty())
+    {
+        LIBSSH2_CHANNEL *channel = _channelPool.takeFirst();
+        if(libssh2_channel_eof(channel))
+        {
+            /* The destination closed the idle connection */
+            libssh2_channel_free(channel);
+            continue;
+        }
+        _poolHits++;
+        /* Refill outside of the accept path */
+        _channelPoolRefused = false;
+        QTimer::singleShot(0, this, SLOT(_fillChannelPool()));
+        return channel;
+    }
+    _poolMisses++;
+    _channelPoolRefused = false;
+    QTimer::singleShot(0, this, SLOT(_fillChannelPool()));
+    return NULL;
+}
+
+void SshTunnelOutSrv::_fillChannelPool()
+{
+    if(!_sshclient->channelReady() || _channelPoolRefused) return;
+    LIBSSH2_SESSION *session = _sshclient->session();
+    quint16 port = _port;
+    /* An open already sent is finished even if the pool was shrunk meanwhile */
+    while(_channelPoolOpening || _channelPool.size() < _channelPoolSize)
+    {
+        if(!_sshclient->lockChannelOpen(this, [session, port]() {
+                LIBSSH2_CHANNEL *dropped = libssh2_channel_direct_tcpip(session, "127.0.0.1", port);
+                if(dropped)
+                {
+                    libssh2_channel_close(dropped);
+                    libssh2_channel_free(dropped);
+                }
+                return dropped != NULL || libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN;
+            }))
+        {
+            return;
+        }
+        _channelPoolOpening = true;
+        LIBSSH2_CHANNEL *channel = libssh2_channel_direct_tcpip(session, "127.0.0.1", port);
+        if(channel == NULL)
+        {
+            if(libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN)
+            {
+                /* Destination refused, retry after the next connection */
+#if defined(DEBUG_SSHCHANNEL)
+                qDebug() << "DEBUG : SshTunnelOutSrv(" << _identifier << ") : channel pool stays at " << _channelPool.size();
+#endif
+                _channelPoolRefused = true;
+                _channelPoolOpening = false;
+                _sshclient->unlockChannelOpen(this);
+            }
+            return;
+        }
+        _channelPoolOpening = false;
+        _sshclient->unlockChannelOpen(this);
+        if(_channelPool.size() >= _channelPoolSize)
+        {
+            libssh2_channel_close(channel);
+            libssh2_channel_free(channel);
+            continue;
+        }
+        _channelPool.append(channel);
+    }
 }
@@ -8,6 +8,18 @@
 class SshTunnelOut;
 class SshClient;
 
+/*
+ * Local port forward. An optional pool keeps direct-tcpip channels to the
+ * destination open in advance, so a new connection does not wait for the
+ * channel open round trip.
+ *
+ * Each pooled channel is a real connection to the destination, made before
+ * any client shows up. Only enable the pool for services that wait for the
+ * client to speak : a server sending a banner on connect (SMTP, FTP, SSH)
+ * hands it to whichever client gets the channel, possibly long after, and
+ * a server closing idle connections leaves dead channels behind (those are
+ * dropped when taken, but the connection then pays the open anyway).
+ */
 class SshTunnelOutSrv : public SshChannel
 {
     Q_OBJECT
@@ -17,6 +29,13 @@ class SshTunnelOutSrv : public SshChannel
     SshClient               *_sshclient;
     QString                 _identifier;
     quint16                 _port;
+    int                     _count;
+    QList<LIBSSH2_CHANNEL*> _channelPool;
+    int                     _channelPoolSize;
+    bool                    _channelPoolRefused;
+    bool                    _channelPoolOpening;
+    quint64                 _poolHits;
+    quint64                 _poolMisses;
 
 public:
     explicit SshTunnelOutSrv(SshClient * client, QString port_identifier, quint16 port);
@@ -24,11 +43,22 @@ public:
     quint16 localPort();
     void sshDataReceived();
 
+    void setChannelPoolSize(int count);
+    int channelPoolSize() const;
+    quint64 channelPoolHits() const;
+    quint64 channelPoolMisses() const;
+
 signals:
 
 public slots:
     void createConnection();
     void connectionDisconnected();
+
+private slots:
+    void _fillChannelPool();
+
+private:
+    LIBSSH2_CHANNEL *_takeChannel();
 };
 
 #endif // SSHTUNNELOUTSRV_H
@@ -0,0 +1,279 @@
+#include "sshutils.h"
+#include <QUuid>
+#include <QStringList>
+#include <QHostAddress>
+#include <QtEndian>
+#include <string.h>
+#include <stdio.h>
+
+QString shellQuote(QString arg)
+{
+    return "'" + arg.replace("'", "'\\''") + "'";
+}
+
+quint64 tarNumber(const char *field, int len)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(field);
+    quint64 value = 0;
+    int i = 0;
+
+    if(p[0] & 0x80)
+    {
+        /* GNU base-256 encoding for large values */
+        value = p[0] & 0x7f;
+        for(i = 1; i < len; ++i) value = (value << 8) | p[i];
+        return value;
+    }
+    while(i < len && p[i] == ' ') ++i;
+    for(; i < len && p[i] >= '0' && p[i] <= '7'; ++i)
+    {
+        value = value * 8 + (p[i] - '0');
+    }
+    return value;
+}
+
+void tarSetNumber(char *field, int len, quint64 value)
+{
+    if(value < (quint64(1) << (3 * (len - 1))))
+    {
+        snprintf(field, len, "%0*llo", len - 1, static_cast<unsigned long long>(value));
+        return;
+    }
+    field[0] = char(0x80);
+    for(int i = len - 1; i > 0; --i)
+    {
+        field[i] = char(value & 0xff);
+        value >>= 8;
+    }
+}
+
+QByteArray tarString(const char *field, int len)
+{
+    return QByteArray(field, int(qstrnlen(field, len)));
+}
+
+unsigned int tarChecksum(const char *header)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(header);
+    unsigned int sum = 0;
+    for(int i = 0; i < TAR_BLOCK_LEN; ++i)
+    {
+        sum += (i >= 148 && i < 156)?(unsigned(' ')):(p[i]);
+    }
+    return sum;
+}
+
+/* Entry name of the header, with the ustar prefix when there is one */
+QByteArray tarHeaderName(const char *header)
+{
+    QByteArray name = tarString(header, 100);
+    QByteArray prefix = tarString(header + 345, 155);
+    if(memcmp(header + 257, "ustar", 5) == 0 && !prefix.isEmpty()) name = prefix + "/" + name;
+    return name;
+}
+
+/* Reject absolute and parent references : every entry must stay below the root */
+bool tarSafePath(const QString &name, QString &relative)
+{
+    QStringList parts;
+    foreach(QString part, name.split("/", SSH_SKIP_EMPTY_PARTS))
+    {
+        if(part == ".") continue;
+        if(part == "..") return false;
+        parts << part;
+    }
+    relative = parts.join("/");
+    return true;
+}
+
+/* VER NMETHODS METHODS... : only "no authentication" is offered */
+int socks5ParseGreeting(const QByteArray &data, bool &noAuth)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+
+    if(data.size() < 2 || data.size() < 2 + p[1]) return 0;
+    noAuth = data.mid(2, p[1]).contains('\0');
+    return 2 + p[1];
+}
+
+/* VER CMD RSV ATYP DST.ADDR DST.PORT, -1 for an unknown address type */
+int socks5ParseRequest(const QByteArray &data, char &command, QString &host, quint16 &port)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    int length;
+
+    if(data.size() < 5) return 0;
+    switch(p[3])
+    {
+    case 0x01:
+        length = 4 + 4 + 2;
+        if(data.size() < length) return 0;
+        host = QHostAddress(qFromBigEndian<quint32>(p + 4)).toString();
+        break;
+    case 0x03:
+        length = 4 + 1 + p[4] + 2;
+        if(data.size() < length) return 0;
+        host = QString::fromUtf8(data.constData() + 5, p[4]);
+        break;
+    case 0x04:
+        length = 4 + 16 + 2;
+        if(data.size() < length) return 0;
+        host = QHostAddress(p + 4).toString();
+        break;
+    default:
+        return -1;
+    }
+    command = char(p[1]);
+    port = qFromBigEndian<quint16>(p + length - 2);
+    return length;
+}
+
+/* CONNECT host:port HTTP/1.1, refusal holds the response when -1 is returned */
+int httpParseConnect(const QByteArray &data, int max, QString &host, quint16 &port, QByteArray &refusal)
+{
+    int end = data.indexOf("\r\n\r\n");
+
+    if(end < 0)
+    {
+        if(data.size() < max) return 0;
+        refusal = "HTTP/1.1 431 Request Header Fields Too Large\r\n\r\n";
+        return -1;
+    }
+
+    QList<QByteArray> request = data.left(data.indexOf("\r\n")).split(' ');
+    if(request.size() != 3 || request.at(0) != "CONNECT")
+    {
+        refusal = "HTTP/1.1 405 Method Not Allowed\r\nAllow: CONNECT\r\n\r\n";
+        return -1;
+    }
+    QByteArray authority = request.at(1);
+    int colon = authority.lastIndexOf(':');
+    bool ok = false;
+    port = (colon > 0)?(authority.mid(colon + 1).toUShort(&ok)):(0);
+    QByteArray name = authority.left(colon);
+    if(name.startsWith('[') && name.endsWith(']'))
+    {
+        name = name.mid(1, name.size() - 2);
+    }
+    if(!ok || name.isEmpty())
+    {
+        refusal = "HTTP/1.1 400 Bad Request\r\n\r\n";
+        return -1;
+    }
+    host = QString::fromUtf8(name);
+    return end + 4;
+}
+
+SshSentinelParser::SshSentinelParser():
+    _token(QUuid::createUuid().toRfc4122().toHex().left(16)),
+    _outIndex(0),
+    _errIndex(0)
+{
+}
+
+QByteArray SshSentinelParser::_marker(quint64 id) const
+{
+    return "__QTSSH_" + _token + "_" + QByteArray::number(id) + "_";
+}
+
+QByteArray SshSentinelParser::frame(quint64 id, const QString &command) const
+{
+    QByteArray marker = _marker(id);
+
+    /*
+     * "command eval" keeps a syntax error from killing the shell, the
+     * sentinels go out whatever the command did. The exit code stays in
+     * $__qtssh_rc for what the caller appends to the frame.
+     */
+    QByteArray frame = "command eval " + shellQuote(command).toUtf8() + " </dev/null\n";
+    frame += "__qtssh_rc=$?\n";
+    frame += "printf '\\n%s%d__\\n' '" + marker + "' $__qtssh_rc\n";
+    frame += "printf '\\n%s__\\n' '" + marker + "' >&2\n";
+    return frame;
+}
+
+void SshSentinelParser::expect(quint64 id)
+{
+    Entry entry;
+    entry.id = id;
+    entry.exitCode = -1;
+    _entries << entry;
+}
+
+int SshSentinelParser::pending() const
+{
+    return _entries.size();
+}
+
+void SshSentinelParser::parseOutput(const QByteArray &data)
+{
+    _stdout.append(data);
+    while(_outIndex < _entries.size())
+    {
+        QByteArray marker = "\n" + _marker(_entries.at(_outIndex).id);
+        int pos = _stdout.indexOf(marker);
+        if(pos < 0) break;
+        int end = _stdout.indexOf("__\n", pos + marker.size());
+        if(end < 0) break;
+
+        Entry &entry = _entries[_outIndex];
+        entry.output   = _stdout.left(pos);
+        entry.exitCode = _stdout.mid(pos + marker.size(), end - pos - marker.size()).toInt();
+        _stdout.remove(0, end + 3);
+        _outIndex++;
+    }
+}
+
+void SshSentinelParser::parseError(const QByteArray &data)
+{
+    _stderr.append(data);
+    while(_errIndex < _entries.size())
+    {
+        QByteArray marker = "\n" + _marker(_entries.at(_errIndex).id) + "__\n";
+        int pos = _stderr.indexOf(marker);
+        if(pos < 0) break;
+
+        _entries[_errIndex].errorOutput = _stderr.left(pos);
+        _stderr.remove(0, pos + marker.size());
+        _errIndex++;
+    }
+}
+
+bool SshSentinelParser::takeFinished(Entry &entry)
+{
+    /* A command is done when both of its sentinels arrived */
+    if(_outIndex == 0 || _errIndex == 0) return false;
+    entry = _entries.takeFirst();
+    _outIndex--;
+    _errIndex--;
+    return true;
+}
+
+bool SshSentinelParser::takeUnfinished(Entry &entry)
+{
+    /* Stream ended : the oldest command gets whatever it printed so far */
+    if(_entries.isEmpty()) return false;
+    entry = _entries.takeFirst();
+    if(_outIndex == 0)
+    {
+        entry.output = _stdout;
+        _stdout.clear();
+    }
+    else _outIndex--;
+    if(_errIndex == 0)
+    {
+        entry.errorOutput = _stderr;
+        _stderr.clear();
+    }
+    else _errIndex--;
+    return true;
+}
+
+void SshSentinelParser::reset()
+{
+    _entries.clear();
+    _stdout.clear();
+    _stderr.clear();
+    _outIndex = 0;
+    _errIndex = 0;
+}
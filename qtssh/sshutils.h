@@ -0,0 +1,80 @@
+#ifndef SSHUTILS_H
+#define SSHUTILS_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+
+/* QString::SkipEmptyParts is deprecated since Qt 5.14 */
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#define SSH_SKIP_EMPTY_PARTS Qt::SkipEmptyParts
+#else
+#define SSH_SKIP_EMPTY_PARTS QString::SkipEmptyParts
+#endif
+
+#define TAR_BLOCK_LEN (512)
+
+/* Single quote an argument for the remote POSIX shell */
+QString shellQuote(QString arg);
+
+/* ustar header fields, used by SshTarTransfer */
+quint64 tarNumber(const char *field, int len);
+void tarSetNumber(char *field, int len, quint64 value);
+QByteArray tarString(const char *field, int len);
+unsigned int tarChecksum(const char *header);
+QByteArray tarHeaderName(const char *header);
+bool tarSafePath(const QString &name, QString &relative);
+
+/*
+ * Proxy requests read by SshSocksSrv, parsed from what was peeked on the
+ * client socket. They return 0 while the request is incomplete, -1 for a
+ * request to refuse, otherwise the number of bytes the request takes.
+ */
+int socks5ParseGreeting(const QByteArray &data, bool &noAuth);
+int socks5ParseRequest(const QByteArray &data, char &command, QString &host, quint16 &port);
+int httpParseConnect(const QByteArray &data, int max, QString &host, quint16 &port, QByteArray &refusal);
+
+/*
+ * Sentinel framing shared by SshShell and SshBatch. Each command is
+ * wrapped by frame() so that a marker carrying its exit code follows it on
+ * stdout and another marker follows it on stderr ; the two streams are fed
+ * to parseOutput() / parseError() as they arrive and takeFinished() hands
+ * back the commands, in order, once both of their markers were seen.
+ */
+class SshSentinelParser
+{
+public:
+    struct Entry {
+        quint64 id;
+        QByteArray output;
+        QByteArray errorOutput;
+        int exitCode;
+    };
+
+private:
+    QByteArray _token;
+    QList<Entry> _entries;
+    QByteArray _stdout;
+    QByteArray _stderr;
+    int _outIndex;
+    int _errIndex;
+
+public:
+    SshSentinelParser();
+
+    QByteArray frame(quint64 id, const QString &command) const;
+    void expect(quint64 id);
+    int pending() const;
+
+    void parseOutput(const QByteArray &data);
+    void parseError(const QByteArray &data);
+    bool takeFinished(Entry &entry);
+    bool takeUnfinished(Entry &entry);
+    void reset();
+
+private:
+    QByteArray _marker(quint64 id) const;
+};
+
+#endif // SSHUTILS_H
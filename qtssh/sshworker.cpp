@@ -129,6 +129,20 @@ QString SshWorker::sendFile(QString src, QString dst)
     return ret;
 }
 
+QStringList SshWorker::sendFiles(QStringList sources, QString dst)
+{
+    QStringList ret;
+    QMetaObject::invokeMethod( _client, "sendFiles", _contype, Q_RETURN_ARG(QStringList, ret), Q_ARG( QStringList, sources ), Q_ARG( QString, dst ) );
+    return ret;
+}
+
+bool SshWorker::getFile(QString src, QString dst)
+{
+    bool ret;
+    QMetaObject::invokeMethod( _client, "getFile", _contype, Q_RETURN_ARG(bool, ret), Q_ARG( QString, src ), Q_ARG( QString, dst ) );
+    return ret;
+}
+
 void SshWorker::setPassphrase(const QString &pass)
 {
     QMetaObject::invokeMethod( _client, "setPassphrase", _contype, Q_ARG( QString, pass ) );
@@ -46,6 +46,9 @@ public slots:
     QString banner();
 /* >>>SshInterface<<< */
 
+    QStringList sendFiles(QStringList sources, QString dst);
+    bool getFile(QString src, QString dst);
+
 
 /* <<<SshFsInterface>>> */
 public slots:
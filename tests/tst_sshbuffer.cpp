@@ -0,0 +1,120 @@
+#include <qtssh/sshbuffer.h>
+#include <QtTest>
+#include <string.h>
+
+class TestSshBuffer : public QObject
+{
+    Q_OBJECT
+
+    static void _write(SshBuffer &buffer, const QByteArray &data)
+    {
+        int done = 0;
+        while(done < data.size())
+        {
+            int len = 0;
+            char *free = buffer.reserve(len);
+            QVERIFY(len > 0);
+            len = qMin(len, data.size() - done);
+            memcpy(free, data.constData() + done, size_t(len));
+            buffer.commit(len);
+            done += len;
+        }
+    }
+
+    static QByteArray _pattern(int size)
+    {
+        QByteArray data(size, Qt::Uninitialized);
+        for(int i = 0; i < size; ++i) data[i] = char('a' + i % 26);
+        return data;
+    }
+
+private slots:
+    void empty()
+    {
+        SshBuffer buffer;
+        char c;
+        QVERIFY(buffer.isEmpty());
+        QCOMPARE(buffer.read(&c, 1), qint64(0));
+        QCOMPARE(buffer.readAll(), QByteArray());
+        QVERIFY(buffer.readBlocks().isEmpty());
+        QCOMPARE(buffer.trim(0), qint64(0));
+    }
+
+    void readAcrossBlocks()
+    {
+        SshBuffer buffer;
+        QByteArray data = _pattern(200 * 1024 + 7);
+        _write(buffer, data);
+        QCOMPARE(buffer.size(), qint64(data.size()));
+
+        QByteArray head(100, '\0');
+        QCOMPARE(buffer.read(head.data(), head.size()), qint64(100));
+        QCOMPARE(head, data.left(100));
+        QCOMPARE(buffer.skip(50), qint64(50));
+        QCOMPARE(buffer.readAll(), data.mid(150));
+        QVERIFY(buffer.isEmpty());
+
+        /* Still usable once drained */
+        _write(buffer, "again");
+        QCOMPARE(buffer.readAll(), QByteArray("again"));
+    }
+
+    void readBlocks()
+    {
+        SshBuffer buffer;
+        QByteArray data = _pattern(150 * 1024);
+        _write(buffer, data);
+        buffer.skip(10);
+
+        QList<QByteArray> blocks = buffer.readBlocks();
+        QVERIFY(blocks.size() > 1);
+        QByteArray joined;
+        foreach(QByteArray block, blocks) joined += block;
+        QCOMPARE(joined, data.mid(10));
+        QVERIFY(buffer.isEmpty());
+        QCOMPARE(buffer.size(), qint64(0));
+
+        _write(buffer, "tail");
+        QCOMPARE(buffer.readBlocks(), QList<QByteArray>() << QByteArray("tail"));
+    }
+
+    void trim()
+    {
+        SshBuffer buffer;
+        QByteArray data = _pattern(100 * 1024);
+        _write(buffer, data);
+
+        QCOMPARE(buffer.trim(data.size()), qint64(0));
+        QCOMPARE(buffer.trim(1000), qint64(data.size() - 1000));
+        QCOMPARE(buffer.size(), qint64(1000));
+        QCOMPARE(buffer.readAll(), data.right(1000));
+    }
+
+    void readAllText()
+    {
+        SshBuffer buffer;
+        /* A two bytes UTF-8 sequence split by the end of the first block */
+        int first = 0;
+        buffer.reserve(first);
+        QByteArray data = QByteArray(first - 1, 'a') + QString::fromUtf8("\xc3\xa9t\xc3\xa9").toUtf8();
+        _write(buffer, data);
+
+        QString text = buffer.readAllText();
+        QCOMPARE(text.size(), first - 1 + 3);
+        QVERIFY(text.endsWith(QString::fromUtf8("\xc3\xa9t\xc3\xa9")));
+        QVERIFY(buffer.isEmpty());
+    }
+
+    void clear()
+    {
+        SshBuffer buffer;
+        _write(buffer, _pattern(70 * 1024));
+        buffer.clear();
+        QVERIFY(buffer.isEmpty());
+        _write(buffer, "x");
+        QCOMPARE(buffer.readAll(), QByteArray("x"));
+    }
+};
+
+QTEST_APPLESS_MAIN(TestSshBuffer)
+#include "tst_sshbuffer.moc"
@@ -0,0 +1,94 @@
+#include <qtssh/sshchunkqueue.h>
+#include <QtTest>
+#include <QThread>
+
+/* Pushes one chunk, blocking while the queue is full */
+class Pusher : public QThread
+{
+public:
+    SshChunkQueue *queue;
+    bool pushed;
+
+    explicit Pusher(SshChunkQueue *q):
+        queue(q),
+        pushed(true)
+    {
+    }
+
+    void run()
+    {
+        pushed = queue->push("late");
+    }
+};
+
+class TestSshChunkQueue : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void fifo()
+    {
+        SshChunkQueue queue(4);
+        QByteArray chunk;
+        QVERIFY(queue.push("one"));
+        QVERIFY(queue.push("two"));
+        queue.close();
+        QVERIFY(!queue.push("three"));
+        QVERIFY(!queue.atEnd());
+        QVERIFY(queue.pop(chunk, 0));
+        QCOMPARE(chunk, QByteArray("one"));
+        QVERIFY(queue.pop(chunk, 0));
+        QCOMPARE(chunk, QByteArray("two"));
+        QVERIFY(queue.atEnd());
+        QVERIFY(!queue.pop(chunk, 0));
+        QVERIFY(!queue.aborted());
+    }
+
+    void popTimeout()
+    {
+        SshChunkQueue queue(4);
+        QByteArray chunk;
+        QVERIFY(!queue.pop(chunk, 10));
+        QVERIFY(!queue.atEnd());
+    }
+
+    void fullUnblockedByPop()
+    {
+        SshChunkQueue queue(1);
+        QByteArray chunk;
+        QVERIFY(queue.push("first"));
+
+        Pusher pusher(&queue);
+        pusher.start();
+        QVERIFY(!pusher.wait(100));
+        QVERIFY(queue.pop(chunk, 0));
+        QVERIFY(pusher.wait(5000));
+        QVERIFY(pusher.pushed);
+        QVERIFY(queue.pop(chunk, 0));
+        QCOMPARE(chunk, QByteArray("late"));
+    }
+
+    void abortWhileFull()
+    {
+        SshChunkQueue queue(2);
+        QByteArray chunk;
+        QVERIFY(queue.push("one"));
+        QVERIFY(queue.push("two"));
+
+        Pusher pusher(&queue);
+        pusher.start();
+        QVERIFY(!pusher.wait(100));
+
+        /* The blocked producer must come back without pushing */
+        queue.abort();
+        QVERIFY(pusher.wait(5000));
+        QVERIFY(!pusher.pushed);
+        QVERIFY(queue.aborted());
+        QVERIFY(queue.atEnd());
+        QVERIFY(!queue.pop(chunk, 0));
+        QVERIFY(!queue.push("after"));
+    }
+};
+
+QTEST_APPLESS_MAIN(TestSshChunkQueue)
+#include "tst_sshchunkqueue.moc"
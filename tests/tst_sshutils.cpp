@@ -0,0 +1,280 @@
+#include <qtssh/sshutils.h>
+#include <QtTest>
+#include <string.h>
+#include <stdio.h>
+
+class TestSshUtils : public QObject
+{
+    Q_OBJECT
+
+    static QByteArray _marker(const SshSentinelParser &parser, quint64 id)
+    {
+        /* The token is private : take the marker back from the frame */
+        QByteArray frame = parser.frame(id, "true");
+        int start = frame.indexOf("'__QTSSH_") + 1;
+        return frame.mid(start, frame.indexOf('\'', start) - start);
+    }
+
+    static QByteArray _header(const QByteArray &name, const QByteArray &prefix, quint64 size)
+    {
+        QByteArray block(TAR_BLOCK_LEN, '\0');
+        char *h = block.data();
+        memcpy(h, name.constData(), size_t(qMin(100, name.size())));
+        tarSetNumber(h + 100, 8, 0644);
+        tarSetNumber(h + 124, 12, size);
+        tarSetNumber(h + 136, 12, 1500000000);
+        h[156] = '0';
+        memcpy(h + 257, "ustar", 6);
+        memcpy(h + 263, "00", 2);
+        memcpy(h + 345, prefix.constData(), size_t(qMin(155, prefix.size())));
+        snprintf(h + 148, 8, "%06o", tarChecksum(h));
+        h[155] = ' ';
+        return block;
+    }
+
+private slots:
+    void shellQuote_data()
+    {
+        QTest::addColumn<QString>("arg");
+        QTest::addColumn<QString>("quoted");
+        QTest::newRow("plain") << "ls -l" << "'ls -l'";
+        QTest::newRow("quote") << "it's" << "'it'\\''s'";
+        QTest::newRow("empty") << "" << "''";
+    }
+
+    void shellQuote()
+    {
+        QFETCH(QString, arg);
+        QFETCH(QString, quoted);
+        QCOMPARE(::shellQuote(arg), quoted);
+    }
+
+    void tarSafePath_data()
+    {
+        QTest::addColumn<QString>("name");
+        QTest::addColumn<bool>("safe");
+        QTest::addColumn<QString>("relative");
+        QTest::newRow("plain")    << "a/b/c" << true << "a/b/c";
+        QTest::newRow("absolute") << "/etc/passwd" << true << "etc/passwd";
+        QTest::newRow("dots")     << "./a/./b/" << true << "a/b";
+        QTest::newRow("root")     << "./" << true << "";
+        QTest::newRow("parent")   << "../a" << false << "";
+        QTest::newRow("inner")    << "a/../../b" << false << "";
+        QTest::newRow("dotdot")   << "a/..b" << true << "a/..b";
+    }
+
+    void tarSafePath()
+    {
+        QFETCH(QString, name);
+        QFETCH(bool, safe);
+        QFETCH(QString, relative);
+        QString result;
+        QCOMPARE(::tarSafePath(name, result), safe);
+        if(safe) QCOMPARE(result, relative);
+    }
+
+    void tarNumbers()
+    {
+        char field[12];
+        tarSetNumber(field, 12, 012345);
+        QCOMPARE(QByteArray(field), QByteArray("00000012345"));
+        QCOMPARE(tarNumber(field, 12), quint64(012345));
+
+        /* Too large for 11 octal digits : GNU base-256 */
+        quint64 large = quint64(1) << 40;
+        tarSetNumber(field, 12, large);
+        QCOMPARE(uchar(field[0]), uchar(0x80));
+        QCOMPARE(tarNumber(field, 12), large);
+
+        /* Leading spaces and a trailing NUL or space are allowed */
+        QCOMPARE(tarNumber("  755 \0", 8), quint64(0755));
+        QCOMPARE(tarString("name\0junk", 9), QByteArray("name"));
+        QCOMPARE(tarString("0123456789", 4), QByteArray("0123"));
+    }
+
+    void tarHeader()
+    {
+        QByteArray block = _header("file.txt", "some/dir", 1234);
+        const char *h = block.constData();
+        QCOMPARE(tarChecksum(h), unsigned(tarNumber(h + 148, 8)));
+        QCOMPARE(tarHeaderName(h), QByteArray("some/dir/file.txt"));
+        QCOMPARE(tarNumber(h + 124, 12), quint64(1234));
+        QCOMPARE(tarNumber(h + 100, 8), quint64(0644));
+        QCOMPARE(tarNumber(h + 136, 12), quint64(1500000000));
+
+        block[10] = 'X';
+        QVERIFY(tarChecksum(block.constData()) != tarNumber(block.constData() + 148, 8));
+
+        /* The prefix only counts in an ustar header */
+        block = _header("file.txt", "some/dir", 0);
+        memset(block.data() + 257, 0, 8);
+        QCOMPARE(tarHeaderName(block.constData()), QByteArray("file.txt"));
+
+        /* A full 100 bytes name is not NUL terminated */
+        QByteArray name(100, 'n');
+        block = _header(name, QByteArray(), 0);
+        QCOMPARE(tarHeaderName(block.constData()), name);
+    }
+
+    void sentinelInOrder()
+    {
+        SshSentinelParser parser;
+        SshSentinelParser::Entry entry;
+        QByteArray m1 = _marker(parser, 1);
+        QByteArray m2 = _marker(parser, 2);
+        QVERIFY(m1 != m2);
+
+        parser.expect(1);
+        parser.expect(2);
+        QCOMPARE(parser.pending(), 2);
+
+        /* Markers split across reads */
+        QByteArray out = "one\n\n" + m1 + "0__\ntwo\n\n" + m2 + "3__\n";
+        parser.parseOutput(out.left(7));
+        parser.parseOutput(out.mid(7, 10));
+        QVERIFY(!parser.takeFinished(entry));
+        parser.parseOutput(out.mid(17));
+        QVERIFY(!parser.takeFinished(entry));
+
+        parser.parseError("\n" + m1 + "__\nerr2\n\n" + m2 + "__\n");
+        QVERIFY(parser.takeFinished(entry));
+        QCOMPARE(entry.id, quint64(1));
+        QCOMPARE(entry.output, QByteArray("one\n"));
+        QCOMPARE(entry.errorOutput, QByteArray());
+        QCOMPARE(entry.exitCode, 0);
+
+        QVERIFY(parser.takeFinished(entry));
+        QCOMPARE(entry.id, quint64(2));
+        QCOMPARE(entry.output, QByteArray("two\n"));
+        QCOMPARE(entry.errorOutput, QByteArray("err2\n"));
+        QCOMPARE(entry.exitCode, 3);
+
+        QVERIFY(!parser.takeFinished(entry));
+        QCOMPARE(parser.pending(), 0);
+    }
+
+    void sentinelUnfinished()
+    {
+        SshSentinelParser parser;
+        SshSentinelParser::Entry entry;
+        QByteArray m1 = _marker(parser, 1);
+
+        parser.expect(1);
+        parser.expect(2);
+        parser.parseOutput("a\n\n" + m1 + "1__\npartial");
+        parser.parseError("\n" + m1 + "__\nerr");
+
+        QVERIFY(parser.takeUnfinished(entry));
+        QCOMPARE(entry.id, quint64(1));
+        QCOMPARE(entry.exitCode, 1);
+        QVERIFY(parser.takeUnfinished(entry));
+        QCOMPARE(entry.id, quint64(2));
+        QCOMPARE(entry.output, QByteArray("partial"));
+        QCOMPARE(entry.errorOutput, QByteArray("err"));
+        QCOMPARE(entry.exitCode, -1);
+        QVERIFY(!parser.takeUnfinished(entry));
+
+        /* A forged marker from another parser is plain output */
+        SshSentinelParser other;
+        other.expect(1);
+        other.parseOutput("\n" + m1 + "0__\n");
+        other.parseError("\n" + m1 + "__\n");
+        QVERIFY(!other.takeFinished(entry));
+        other.reset();
+        QCOMPARE(other.pending(), 0);
+    }
+
+    void socks5Greeting()
+    {
+        bool noAuth = false;
+        QCOMPARE(socks5ParseGreeting(QByteArray("\x05", 1), noAuth), 0);
+        QCOMPARE(socks5ParseGreeting(QByteArray("\x05\x02\x00", 3), noAuth), 0);
+        QCOMPARE(socks5ParseGreeting(QByteArray("\x05\x02\x02\x00\x05", 5), noAuth), 4);
+        QVERIFY(noAuth);
+        QCOMPARE(socks5ParseGreeting(QByteArray("\x05\x01\x02", 3), noAuth), 3);
+        QVERIFY(!noAuth);
+    }
+
+    void socks5Request_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+        QTest::addColumn<int>("length");
+        QTest::addColumn<QString>("host");
+        QTest::addColumn<int>("port");
+        QTest::newRow("ipv4")   << QByteArray("\x05\x01\x00\x01\x7f\x00\x00\x01\x00\x50", 10) << 10 << "127.0.0.1" << 80;
+        QTest::newRow("domain") << QByteArray("\x05\x01\x00\x03\x07" "example\x01\xbb", 14) << 14 << "example" << 443;
+        QTest::newRow("ipv6")   << QByteArray("\x05\x01\x00\x04" "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01" "\x00\x16", 22) << 22 << "::1" << 22;
+        QTest::newRow("short")  << QByteArray("\x05\x01\x00\x03\x07" "exam", 9) << 0 << "" << 0;
+        QTest::newRow("atyp")   << QByteArray("\x05\x01\x00\x02\x00\x00", 6) << -1 << "" << 0;
+    }
+
+    void socks5Request()
+    {
+        QFETCH(QByteArray, data);
+        QFETCH(int, length);
+        QFETCH(QString, host);
+        QFETCH(int, port);
+        char command = 0;
+        QString parsedHost;
+        quint16 parsedPort = 0;
+        QCOMPARE(socks5ParseRequest(data, command, parsedHost, parsedPort), length);
+        if(length > 0)
+        {
+            QCOMPARE(command, char(0x01));
+            QCOMPARE(parsedHost, host);
+            QCOMPARE(int(parsedPort), port);
+        }
+    }
+
+    void socks5Command()
+    {
+        char command = 0;
+        QString host;
+        quint16 port = 0;
+        QCOMPARE(socks5ParseRequest(QByteArray("\x05\x02\x00\x01\x7f\x00\x00\x01\x00\x50", 10), command, host, port), 10);
+        QCOMPARE(command, char(0x02));
+    }
+
+    void httpConnect_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+        QTest::addColumn<int>("length");
+        QTest::addColumn<QString>("host");
+        QTest::addColumn<int>("port");
+        QTest::addColumn<QByteArray>("status");
+        QByteArray plain = "CONNECT example.com:443 HTTP/1.1\r\nHost: example.com\r\n\r\n";
+        QTest::newRow("plain")   << plain + "data" << plain.size() << "example.com" << 443 << QByteArray();
+        QTest::newRow("ipv6")    << QByteArray("CONNECT [::1]:22 HTTP/1.1\r\n\r\n") << 29 << "::1" << 22 << QByteArray();
+        QTest::newRow("partial") << QByteArray("CONNECT example.com:443 HTTP/1.1\r\n") << 0 << "" << 0 << QByteArray();
+        QTest::newRow("method")  << QByteArray("GET / HTTP/1.1\r\n\r\n") << -1 << "" << 0 << QByteArray("405");
+        QTest::newRow("noport")  << QByteArray("CONNECT example.com HTTP/1.1\r\n\r\n") << -1 << "" << 0 << QByteArray("400");
+        QTest::newRow("badport") << QByteArray("CONNECT example.com:99999 HTTP/1.1\r\n\r\n") << -1 << "" << 0 << QByteArray("400");
+        QTest::newRow("nohost")  << QByteArray("CONNECT :80 HTTP/1.1\r\n\r\n") << -1 << "" << 0 << QByteArray("400");
+        QTest::newRow("large")   << QByteArray(64, 'A') << -1 << "" << 0 << QByteArray("431");
+    }
+
+    void httpConnect()
+    {
+        QFETCH(QByteArray, data);
+        QFETCH(int, length);
+        QFETCH(QString, host);
+        QFETCH(int, port);
+        QFETCH(QByteArray, status);
+        QString parsedHost;
+        quint16 parsedPort = 0;
+        QByteArray refusal;
+        QCOMPARE(httpParseConnect(data, 64, parsedHost, parsedPort, refusal), length);
+        if(length > 0)
+        {
+            QCOMPARE(parsedHost, host);
+            QCOMPARE(int(parsedPort), port);
+        }
+        if(length < 0)
+        {
+            QVERIFY(refusal.startsWith("HTTP/1.1 " + status + " "));
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(TestSshUtils)
+#include "tst_sshutils.moc"